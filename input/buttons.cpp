@@ -0,0 +1,79 @@
+/*
+ * input/buttons.cpp - part of PIM670 Zabbix Display
+ *
+ * The button logic is header only; this is its test.
+ */
+
+#include "input/buttons.hpp"
+
+#ifdef RUNTESTS
+# include <cmath>
+# include <cstdio>
+# include <initializer_list>
+#endif
+
+#ifdef RUNTESTS
+using namespace input;
+
+/* Hold for hold_us, calling hold() every period_us; the total change. */
+static float ramp(uint32_t hold_us, uint32_t period_us)
+{
+    Ramp ramp(0.02f, 1.0f);
+    uint32_t now = 1000000;
+    float total = ramp.press(now);
+    for (uint32_t t = period_us; t <= hold_us; t += period_us)
+    {
+        total += ramp.hold(now + t);
+    }
+    return total;
+}
+
+int main()
+{
+    int errors = 0;
+    Debouncer button;
+    int changes = 0;
+
+    /* A bouncy press: one change. */
+    uint32_t t = 1000000;
+    for (uint32_t bounce : {0, 300, 800, 1500, 4000})
+    {
+        changes += button.update(bounce % 3 != 2, t + bounce);
+    }
+    if (changes != 1 || !button.pressed() || button.since_us() != t)
+    {
+        printf("buttons: bouncy press gives %d changes\n", changes);
+        ++errors;
+    }
+
+    /* A tap so short the release edge is taken for bounce: sampling the
+     * pin afterwards releases it. */
+    button.update(false, t + 5000);
+    if (!button.pressed())
+    {
+        printf("buttons: release inside the bounce time not ignored\n");
+        ++errors;
+    }
+    button.update(false, t + Debouncer::DEBOUNCE_US);
+    if (button.pressed())
+    {
+        printf("buttons: sample does not release the button\n");
+        ++errors;
+    }
+
+    /* The ramp does not depend on how often it is called. */
+    float fast = ramp(1300000, 10000);
+    float slow = ramp(1300000, 65000);
+    if (std::fabs(fast - 1.02f) > 0.001f || std::fabs(slow - 1.02f) > 0.001f
+        || ramp(200000, 10000) != 0.02f)
+    {
+        printf("buttons: ramp gives %f and %f, want 1.02\n", fast, slow);
+        ++errors;
+    }
+
+    printf("buttons: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
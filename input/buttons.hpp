@@ -0,0 +1,100 @@
+/*
+ * input/buttons.hpp - part of PIM670 Zabbix Display
+ *
+ * Turns raw button edges into presses and releases, and held buttons into
+ * a steady ramp.
+ *
+ * The edges come from the GPIO interrupt, timestamped. A change is taken
+ * at once and anything within DEBOUNCE_US after it is contact bounce.
+ * Because that may swallow a real edge, the caller also feeds the pin
+ * level now and then while a button is down, which brings the state
+ * back in line.
+ */
+#ifndef INCLUDED_INPUT_BUTTONS_HPP
+#define INCLUDED_INPUT_BUTTONS_HPP
+
+#include <cstdint>
+
+namespace input {
+
+/* What the interrupt handler queues. */
+struct Edge
+{
+    uint8_t button;
+    bool pressed;
+    uint32_t time_us;
+};
+
+class Debouncer
+{
+public:
+    static constexpr uint32_t DEBOUNCE_US = 20000;
+
+    /* An edge or a sample of the pin. Returns true if the debounced
+     * state changed. */
+    bool update(bool pressed, uint32_t now_us)
+    {
+        if (pressed == m_pressed || now_us - m_since_us < DEBOUNCE_US)
+        {
+            return false;
+        }
+        m_pressed = pressed;
+        m_since_us = now_us;
+        return true;
+    }
+
+    bool pressed() const
+    {
+        return m_pressed;
+    }
+    /* When the state last changed. */
+    uint32_t since_us() const
+    {
+        return m_since_us;
+    }
+
+private:
+    bool m_pressed = false;
+    uint32_t m_since_us = 0;
+};
+
+/* A step on press; after DELAY_US held, a steady change per second, no
+ * matter how often the caller gets to it. */
+class Ramp
+{
+public:
+    static constexpr uint32_t DELAY_US = 300000;
+
+    Ramp(float step, float per_second) : m_step(step), m_per_second(per_second)
+    {
+    }
+
+    /* The button went down at now_us. */
+    float press(uint32_t now_us)
+    {
+        m_last_us = now_us + DELAY_US;
+        return m_step;
+    }
+    /* Still down at now_us; the change since the last call. */
+    float hold(uint32_t now_us)
+    {
+        int32_t elapsed = now_us - m_last_us;
+        if (elapsed <= 0)
+        {
+            return 0.0f;
+        }
+        m_last_us = now_us;
+        return m_per_second * elapsed / 1000000.0f;
+    }
+
+private:
+    float m_step;
+    float m_per_second;
+    uint32_t m_last_us = 0;
+};
+
+} // namespace input
+
+#endif // INCLUDED_INPUT_BUTTONS_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -4,14 +4,20 @@
 
 /* Standard header files. */
 
-#include <cmath> // for std::ceil
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* SDK header files. */
 
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "hardware/vreg.h"
 #include "hardware/watchdog.h"
 #include "pico/cyw43_arch.h"
+#include "pico/multicore.h"
 #include "pico/stdlib.h"
 
 /* Local header files. */
@@ -19,7 +25,18 @@
 #include "opt/config.h"
 #include "opt/httpclient.h"
 #include "opt/internals.h"
+#include "input/buttons.hpp"
+#include "render/palette.hpp"
+#include "render/renderer.hpp"
+#include "render/snapshot.hpp"
+#include "render/triplebuffer.hpp"
+#include "sched/governor.hpp"
+#include "sched/pollinterval.hpp"
+#include "sched/scheduler.hpp"
+#include "sched/spscqueue.hpp"
+#include "sched/supervisor.hpp"
 #include "usbfs.h"
+#include "zabbix/csvreader.hpp"
 
 /* Stuff from pimoroni example */
 
@@ -28,6 +45,8 @@
 
 /* Our stuff. */
 
+#include <algorithm>
+#include <atomic>
 #include <string>
 
 typedef enum States
@@ -39,7 +58,28 @@ typedef enum States
     ST_SLEEP
 } State;
 
-std::vector<std::string> split(const std::string& s);
+/* Buttons, by their index in the edge queue. */
+typedef enum Buttons
+{
+    BTN_A = 0,
+    BTN_B,
+    BTN_C,
+    BTN_D,
+    BTN_BRIGHTER,
+    BTN_DIMMER,
+    BUTTONS
+} Button;
+
+/* What a button does when pressed; see action_names. */
+typedef enum Actions
+{
+    ACT_NONE = 0,
+    ACT_REFRESH,
+    ACT_ENGINE,
+    ACT_BRIGHTER,
+    ACT_DIMMER,
+    ACTIONS
+} Action;
 
 class ZabbixAlert
 {
@@ -51,17 +91,12 @@ public:
     {
     }
 
-    static ZabbixAlert from_csv(const std::string& s)
+    static ZabbixAlert from_row(const zabbix::CsvReader::Row& row)
     {
-        /* "<time>;<severity>;<suppr>;<hostid>;<hostname>;<message>" */
-        std::vector<std::string> result = split(s);
-        if (result.size() == 6)
+        if (row.valid)
         {
             return ZabbixAlert(
-                static_cast<uint32_t>(std::stoul(result[0])),
-                static_cast<uint32_t>(std::stoul(result[3])),
-                static_cast<uint8_t>(std::stoul(result[1])),
-                static_cast<uint8_t>(std::stoul(result[2])));
+                row.clock, row.hostid, row.severity, row.suppressed);
         }
         else
         {
@@ -89,73 +124,411 @@ public:
     {
         return compare(other);
     }
+
+    // There is no triggerid in the CSV; host and start time tell the
+    // alerts apart well enough to animate them.
+    uint32_t id() const
+    {
+        return hostid * 2654435761u ^ clock;
+    }
+};
+
+/* What core0 tells the display on core1. */
+struct DisplayState
+{
+    std::vector<render::Block> blocks;
+    render::BackgroundEngine engine = render::BG_PIXEL;
+    uint32_t last_update = 0;
+    /* Turn gray when last_update is older than this (ms). */
+    uint32_t stale_after = 0;
+    /* Degrade when frames keep taking longer than this. */
+    uint32_t frame_budget_us = 8000;
+    /* Display brightness, 0..1. */
+    float brightness = 0.5f;
+    /* Bumped for every new set of blocks. */
+    uint32_t blocks_seq = 0;
 };
 
 /* Globals. */
 
 using pimoroni::Point;
 using pimoroni::Rect;
+namespace palette = render::palette;
 
-pimoroni::PicoGraphics_PenRGB888 graphics(32, 32, nullptr);
+/* Both picked by FRAME_FORMAT at boot. */
+pimoroni::PicoGraphics* graphics;
 pimoroni::CosmicUnicorn cosmic_unicorn;
 
-float lifetime[32][32];
-float age[32][32];
+/* Owned by core1, once it runs. */
+render::Renderer* renderer;
+
+/* Owned by core0; copied to core1 through display_state on publish. */
+DisplayState display;
+render::TripleBuffer<DisplayState> display_state;
+/* The blocks_seq that core1 has fully animated in. */
+std::atomic<uint32_t> display_shown;
+/* Owned by core1: frame times and the quality they allow. */
+render::FrameBudget frame_budget;
+
+/* The tasks of each core; see the *Task classes. */
+sched::Scheduler core0_tasks(time_us_32);
+sched::Scheduler core1_tasks(time_us_32);
+
+/* Owned by core0: when to poll Zabbix next. */
+sched::PollInterval poll_interval;
+/* We turn gray after missing two polls, but never sooner than this. */
+constexpr uint32_t updates_at_least_every = 30000;
+/* Frame interval of the display loop on core1. */
+constexpr int frame_interval_ms = 10;
+
+/* Owned by core0: the buttons, what they do, and their edges, queued by
+ * the GPIO interrupt on core0. */
+const uint button_pins[BUTTONS] = {
+    pimoroni::CosmicUnicorn::SWITCH_A,
+    pimoroni::CosmicUnicorn::SWITCH_B,
+    pimoroni::CosmicUnicorn::SWITCH_C,
+    pimoroni::CosmicUnicorn::SWITCH_D,
+    pimoroni::CosmicUnicorn::SWITCH_BRIGHTNESS_UP,
+    pimoroni::CosmicUnicorn::SWITCH_BRIGHTNESS_DOWN};
+const char* const action_names[ACTIONS] = {
+    "none", "refresh", "engine", "brighter", "dimmer"};
+Action button_actions[BUTTONS] = {
+    ACT_REFRESH, ACT_ENGINE, ACT_NONE, ACT_NONE, ACT_BRIGHTER, ACT_DIMMER};
+sched::SpscQueue<input::Edge, 32> button_edges;
+
+/* Recoveries short of a reboot are counted by the supervisor; these are
+ * the others. Reboots by the hardware watchdog are counted in its scratch
+ * registers, which survive them. */
+sched::Counter http_timeouts;
+uint32_t watchdog_reboots;
+constexpr uint32_t WATCHDOG_REBOOTS_MAGIC = 0x7ab6ac01;
+
+/* Connection setup (DNS, connect, TLS handshake) of the requests so far,
+ * and how much of it went before the poll deadline, in ms. */
+sched::Counter http_setup_ms;
+sched::Counter http_hidden_ms;
+
+/* Boot progress, in us since boot: the first frame with the alerts, from
+ * flash or from Zabbix, and the first answer from Zabbix. 0 until then. */
+std::atomic<uint32_t> first_frame_us;
+uint32_t first_data_us;
+/* Set before core1 starts: blink before the first frame. */
+bool rebooted_by_watchdog;
 
-State app_state;
-int http_state;
-uint32_t wait_until;
-/* We expect updates every 15 s, so after 30 s we turn gray. */
-constexpr int updates_at_least_every = 30000;
-uint32_t last_update;
+/* Share of the time each core slept, over the last stats interval. */
+constexpr uint32_t stats_interval_us = 60000000;
+uint32_t idle_percent[2];
 
 int boot_delay;
 int watchdog_timer;
+uint32_t warmup_ms;
 std::string trigger_url;
 std::string auth_header;
 
-int http_status;
-std::string http_response;
-httpclient_request_t* http_request;
+/* Functions. */
+
+uint32_t millis()
+{
+    return to_ms_since_boot(get_absolute_time());
+}
 
-std::vector<ZabbixAlert> alerts;
+/* Sleep until an interrupt or for at most us microseconds. */
+void wait_for_event(uint32_t us)
+{
+    best_effort_wfe_or_timeout(make_timeout_time_us(us));
+}
 
-constexpr float hue(float hue360)
+/* The XIP cache counters, for the schedulers. Both cores share them, so
+ * a task's numbers include what the other core did meanwhile. They stop
+ * at 2^32: clear them well before that. */
+void xip_cache_probe(uint32_t& hits, uint32_t& accesses)
 {
-    return hue360 / 360.0;
+    hits = xip_ctrl_hw->ctr_hit;
+    accesses = xip_ctrl_hw->ctr_acc;
+    if (accesses >= 0x80000000u)
+    {
+        /* Any write clears. */
+        xip_ctrl_hw->ctr_hit = 0;
+        xip_ctrl_hw->ctr_acc = 0;
+        hits = accesses = 0;
+    }
 }
 
-constexpr float HUE_RED = hue(0);
-constexpr float HUE_ORANGE = hue(30);
-constexpr float HUE_YELLOW = hue(60);
-constexpr float HUE_LIME = hue(90);
-constexpr float HUE_GREEN = hue(120);
+void publish_display()
+{
+    display_state.write_buffer() = display;
+    display_state.publish();
+}
 
-/* Functions. */
+/* Clock governor: system clock per level, in kHz. NORMAL is what we
+ * booted with. Above MAX_STOCK_KHZ the core needs a higher voltage. */
+uint32_t clock_khz[sched::Governor::LEVELS] = {96000, 125000, 200000};
+constexpr uint32_t MIN_CLOCK_KHZ = 48000;
+constexpr uint32_t MAX_STOCK_KHZ = 133000;
+constexpr uint32_t MAX_CLOCK_KHZ = 200000;
 
-std::vector<std::string> split(const std::string& s)
+/* Keep the PIO state machines (display, WiFi SPI) at the speed they were
+ * set up for, as far as their dividers (>= 1) allow. */
+void rescale_pio(uint32_t old_khz, uint32_t new_khz)
 {
-    std::vector<std::string> tokens;
-    size_t spos = 0;
-    size_t epos;
-    std::string token;
-    while ((epos = s.find(";", spos)) != std::string::npos)
+    for (PIO pio : {pio0, pio1})
     {
-        tokens.push_back(s.substr(spos, epos - spos));
-        spos = epos + 1;
+        for (uint sm = 0; sm < 4; ++sm)
+        {
+            if (!pio_sm_is_claimed(pio, sm))
+            {
+                continue;
+            }
+            /* In 1/256ths: INT in 31:16, FRAC in 15:8. */
+            uint64_t div = pio->sm[sm].clkdiv >> PIO_SM0_CLKDIV_FRAC_LSB;
+            div = div * new_khz / old_khz;
+            div = std::min<uint64_t>(std::max<uint64_t>(div, 256), 0xffffff);
+            pio_sm_set_clkdiv_int_frac(pio, sm, div >> 8, div & 0xff);
+        }
     }
-    tokens.push_back(s.substr(spos));
-    return tokens;
 }
 
-uint32_t millis()
+bool set_clock_level(sched::Governor::Level level)
 {
-    return to_ms_since_boot(get_absolute_time());
+    static uint32_t current_khz = clock_khz[sched::Governor::NORMAL];
+    uint32_t khz = clock_khz[level];
+    if (khz == current_khz)
+    {
+        return true;
+    }
+    /* No WiFi SPI transfers while the PIO dividers do not match. */
+    cyw43_arch_lwip_begin();
+    bool ok;
+    if (khz > current_khz)
+    {
+        if (khz > MAX_STOCK_KHZ)
+        {
+            vreg_set_voltage(VREG_VOLTAGE_1_15);
+            busy_wait_us_32(1000);
+        }
+        rescale_pio(current_khz, khz);
+        ok = set_sys_clock_khz(khz, false);
+        if (!ok)
+        {
+            rescale_pio(khz, current_khz);
+        }
+    }
+    else
+    {
+        ok = set_sys_clock_khz(khz, false);
+        if (ok)
+        {
+            rescale_pio(current_khz, khz);
+            if (khz <= MAX_STOCK_KHZ)
+            {
+                vreg_set_voltage(VREG_VOLTAGE_DEFAULT);
+            }
+        }
+    }
+    cyw43_arch_lwip_end();
+    if (ok)
+    {
+        current_khz = khz;
+    }
+    return ok;
+}
+
+sched::Governor governor(time_us_32, set_clock_level, 2);
+
+/* Restarts the tasks that stop beating; the hardware watchdog is only fed
+ * while it copes. */
+sched::Supervisor supervisor(time_us_32, 4);
+/* Fetch has its own timeouts per HTTP state; this is the backstop. */
+constexpr uint32_t FETCH_TIMEOUT_US = 60000000;
+constexpr uint32_t USB_TIMEOUT_US = 5000000;
+/* Flash writes pause core1, but not for this long. */
+constexpr uint32_t RENDER_TIMEOUT_US = 5000000;
+
+/* Fill the display with a single colour, whatever the frame format. */
+void show_color(uint32_t rgb)
+{
+    uint8_t r = rgb >> 16;
+    uint8_t g = (rgb >> 8) & 0xff;
+    uint8_t b = rgb & 0xff;
+    if (graphics->pen_type == pimoroni::PicoGraphics::PEN_P8)
+    {
+        /* Above the renderer's inks. */
+        graphics->update_pen(255, r, g, b);
+        graphics->set_pen(255);
+    }
+    else
+    {
+        graphics->set_pen(r, g, b);
+    }
+    graphics->rectangle(Rect(0, 0, 32, 32));
+    cosmic_unicorn.update(graphics);
+}
+
+/* Core1: take the latest state from core0 and draw the next frame. */
+class RenderTask : public sched::Task
+{
+public:
+    RenderTask() : Task("render", 1)
+    {
+    }
+
+    uint32_t run(uint32_t now_us) override
+    {
+        /* After a reboot by watchdog, blink first. */
+        if (rebooted_by_watchdog && m_blinks < 2 * REBOOT_BLINKS)
+        {
+            show_color(palette::reboot[(m_blinks + 1) % 2]);
+            ++m_blinks;
+            beat(now_us);
+            return BLINK_US;
+        }
+
+        /* A frame takes from when it should have started: core1 may have
+         * been stalled, e.g. while core0 wrote to flash. */
+        uint32_t start_us = m_started ? m_next_frame_us : now_us;
+        m_started = true;
+
+        /* All no-ops if nothing changed. */
+        const DisplayState& state = display_state.read();
+        renderer->set_background_engine(state.engine);
+        renderer->set_blocks(state.blocks);
+        renderer->set_frame_budget_us(state.frame_budget_us);
+
+        /* Lightness depends on wifi/connection state. */
+        bool has_recent_data =
+            ((millis() - state.last_update) < state.stale_after);
+
+        /* The display applies brightness when it gets a frame, so a
+         * brightness change needs one too. */
+        bool brightness_changed = (state.brightness != m_brightness);
+        if (brightness_changed)
+        {
+            cosmic_unicorn.set_brightness(state.brightness);
+            m_brightness = state.brightness;
+        }
+
+        /* Update display. */
+        if (renderer->render(has_recent_data) || brightness_changed)
+        {
+            cosmic_unicorn.update(graphics);
+            if (first_frame_us == 0)
+            {
+                first_frame_us = time_us_32();
+            }
+        }
+        if (!renderer->transitioning())
+        {
+            display_shown = state.blocks_seq;
+        }
+        beat(now_us);
+        /* Animating is the only real work here. */
+        governor.demand(
+            sched::Governor::RENDER, renderer->transitioning()
+                                         ? sched::Governor::NORMAL
+                                         : sched::Governor::LOW);
+
+        frame_budget.set_budget_us(state.frame_budget_us);
+        renderer->set_quality(
+            frame_budget.add_frame(time_us_32() - start_us));
+
+        /* Keep a steady pace; if we fell behind, don't try to catch up. */
+        m_next_frame_us += frame_interval_ms * 1000;
+        if (static_cast<int32_t>(m_next_frame_us - time_us_32()) < 0)
+        {
+            m_next_frame_us = time_us_32();
+        }
+        return m_next_frame_us - now_us;
+    }
+
+private:
+    static constexpr int REBOOT_BLINKS = 2;
+    static constexpr uint32_t BLINK_US = 200000;
+
+    int m_blinks = 0;
+    bool m_started = false;
+    uint32_t m_next_frame_us = 0;
+    float m_brightness = -1.0f;
+};
+
+void core1_main()
+{
+    /* Let core0 pause us while it writes to flash; we run from it. */
+    multicore_lockout_victim_init();
+
+    while (true)
+    {
+        core1_tasks.run_for(1000000, wait_for_event);
+    }
+}
+
+/* The P8 renderer keeps its colours in the PicoGraphics palette. */
+void set_palette(int index, uint32_t rgb)
+{
+    graphics->update_pen(index, rgb >> 16, (rgb >> 8) & 0xff, rgb & 0xff);
+}
+
+void create_graphics(render::FrameFormat format)
+{
+    if (format == render::FRAME_P8)
+    {
+        graphics = new pimoroni::PicoGraphics_PenP8(32, 32, nullptr);
+        renderer = new render::RendererP8(
+            graphics->frame_buffer, time_us_32, set_palette);
+    }
+    else
+    {
+        graphics = new pimoroni::PicoGraphics_PenRGB888(32, 32, nullptr);
+        renderer =
+            new render::RendererRGB888(graphics->frame_buffer, time_us_32);
+    }
+}
+
+/* Set value to config setting name, if that is a number >= 0. */
+void config_get_number(const char* name, uint32_t& value)
+{
+    const char* value_str = config_get(name);
+    int parsed;
+    if (value_str != NULL && (parsed = atoi(value_str)) >= 0)
+    {
+        value = parsed;
+    }
+}
+
+/* Set the action of a button, if the setting names one. */
+void config_button(const char* name, Button button)
+{
+    const char* value_str = config_get(name);
+    if (value_str == NULL)
+    {
+        return;
+    }
+    for (int action = 0; action < ACTIONS; ++action)
+    {
+        if (strcmp(value_str, action_names[action]) == 0)
+        {
+            button_actions[button] = static_cast<Action>(action);
+            return;
+        }
+    }
+    printf("%s: no such action \"%s\"\n", name, value_str);
 }
 
-int is_after(uint32_t until)
+/* Set the clock for a governor level, if the PLL can make it. */
+void config_clock_khz(
+    const char* name, sched::Governor::Level level, uint32_t min_khz,
+    uint32_t max_khz)
 {
-    return (int32_t)(until - millis()) < 0;
+    uint32_t khz = clock_khz[level];
+    config_get_number(name, khz);
+    unsigned vco, postdiv1, postdiv2;
+    if (khz < min_khz || khz > max_khz
+        || !check_sys_clock_khz(khz, &vco, &postdiv1, &postdiv2))
+    {
+        printf("%s: cannot run at %lu kHz\n", name, (unsigned long)khz);
+        return;
+    }
+    /* Takes effect at the next switch to the level. */
+    clock_khz[level] = khz;
 }
 
 void update_from_config()
@@ -187,6 +560,54 @@ void update_from_config()
     {
         watchdog_disable();
     }
+    /* Poll intervals, in ms. */
+    sched::PollInterval::Bounds bounds;
+    config_get_number("POLL_INTERVAL", bounds.interval);
+    config_get_number("POLL_FAST_INTERVAL", bounds.fast_interval);
+    config_get_number("POLL_FAST_PERIOD", bounds.fast_period);
+    config_get_number("POLL_QUIET_PERIOD", bounds.quiet_period);
+    config_get_number("POLL_MAX_INTERVAL", bounds.max_interval);
+    config_get_number("POLL_JITTER_PERCENT", bounds.jitter_percent);
+    poll_interval.set_bounds(bounds);
+    /* Connect this many ms before the poll deadline; 0 is off. The
+     * client holds a connection for so long only, connecting included. */
+    config_get_number("WARMUP_MS", warmup_ms);
+    warmup_ms = std::min<uint32_t>(
+        warmup_ms, (PCBP_HTTP_HELD_SECS - PCBP_HTTP_TIMEOUT_SECS) * 1000);
+    /* Resolver cache, in s. */
+    uint32_t dns_min_ttl = PCBP_HTTP_DNS_MIN_SECS;
+    uint32_t dns_max_ttl = PCBP_HTTP_DNS_MAX_SECS;
+    config_get_number("DNS_MIN_TTL", dns_min_ttl);
+    config_get_number("DNS_MAX_TTL", dns_max_ttl);
+    httpclient_set_dns_ttl(dns_min_ttl, dns_max_ttl);
+    /* Frame budget, in us; slower frames degrade the display. */
+    config_get_number("FRAME_BUDGET_US", display.frame_budget_us);
+    /* Clock governor: "on" or "off"; the levels in kHz. */
+    governor.set_enabled(
+        (value_str = config_get("CLOCK_GOVERNOR")) == NULL
+        || strcmp(value_str, "off") != 0);
+    config_clock_khz(
+        "CLOCK_LOW_KHZ", sched::Governor::LOW, MIN_CLOCK_KHZ,
+        clock_khz[sched::Governor::NORMAL]);
+    config_clock_khz(
+        "CLOCK_HIGH_KHZ", sched::Governor::HIGH,
+        clock_khz[sched::Governor::NORMAL], MAX_CLOCK_KHZ);
+    /* What the A-D buttons do; see action_names. */
+    config_button("BUTTON_A", BTN_A);
+    config_button("BUTTON_B", BTN_B);
+    config_button("BUTTON_C", BTN_C);
+    config_button("BUTTON_D", BTN_D);
+    /* Background engine: per "pixel" or bit-parallel "bitboard". */
+    if ((value_str = config_get("BACKGROUND_ENGINE")) != NULL
+        && strcmp(value_str, "bitboard") == 0)
+    {
+        display.engine = render::BG_BITBOARD;
+    }
+    else
+    {
+        display.engine = render::BG_PIXEL;
+    }
+    publish_display();
     /* Switch to potentially new WiFi credentials. */
     httpclient_set_credentials(
         config_get("WIFI_SSID"), config_get("WIFI_PASSWORD"));
@@ -197,375 +618,1071 @@ void update_from_config()
          + "\r\n");
 }
 
-int main()
+/* Core0: fetch the alerts from Zabbix and publish them to core1. */
+class FetchTask : public sched::Task
 {
-    /* Initialise stdio handling. */
-    stdio_init_all();
+public:
+    FetchTask() : Task("fetch", 2)
+    {
+    }
 
-    /* Initialise the WiFi chipset. */
-    if (cyw43_arch_init())
+    uint32_t run(uint32_t now_us) override
     {
-        printf("Failed to initialise the WiFI chipset (cyw43)\n");
-        return 1;
+        switch (m_state)
+        {
+        case ST_DO_REQUEST:
+            return do_request();
+        case ST_WAIT_RESPONSE:
+            return wait_response(now_us);
+        case ST_HANDLE_RESPONSE:
+            return handle_response(now_us);
+        case ST_TRANSITION:
+            /* Core1 animates the change on its own frame budget; we only
+             * wait for it to finish, and never past the next request. */
+            if (display_shown != display.blocks_seq && !expired(now_us))
+            {
+                beat(now_us);
+                return POLL_US;
+            }
+            m_state = ST_SLEEP;
+            /* fall through */
+        case ST_SLEEP:
+            if (!expired(now_us))
+            {
+                /* Nothing to expect from us until the deadline, but we
+                 * may connect before it. */
+                beat(m_deadline_us);
+                return warm_up(now_us);
+            }
+            m_state = ST_DO_REQUEST;
+            return 0;
+        }
+        return POLL_US;
     }
 
-    /* And the USB handling. */
-    usbfs_init();
+    /* The request stalled past its own timeouts: drop the connection,
+     * from the second attempt also the WiFi, and retry later. */
+    bool restart(int attempt) override
+    {
+        printf("Restarting fetch (attempt %d)\n", attempt);
+        close_request();
+        if (attempt > 1)
+        {
+            httpclient_disconnect();
+        }
+        m_http_state = HTTPCLIENT_NONE;
+        m_results.clear();
+        m_state = ST_SLEEP;
+        sleep(sched::PollInterval::FAILED, time_us_32());
+        return true;
+    }
 
-    /* Declare some default configuration details. */
-    config_t default_config[] = {
-        /* NOTE: We use the BOOT_DELAY for a delay during startup. That way
-         * way we can attach a serial console in time and check debug info. */
-        {"BOOT_DELAY", "0"},
-        /* While the HTTP code is flaky, we use the watchdog to restart.
-         * This is limited to 8388 ms. We'll cap it to 8000 ms. */
-        {"WATCHDOG_TIMER", "8000"},
-        /* NOTE: There's no need to update these here! You can replace them
-         * in CONFIG.TXT after mounting the runtime mount point (usbfs!). */
-        {"WIFI_SSID", "my_network"},
-        {"WIFI_PASSWORD", "my_password"},
-        /* NOTE: We need a separate api_csv.php, as the api_jsonrpc.php
-         * requires multiple calls.
-         * NOTE: The TLS handler does not support TLS 1.3, so the side
-         * needs 1.2 or lower.
-         * NOTE: If the site has PFS the certificate needs to be ECDSA.
-         * For RSA RSA we'd need a cipher without DHE. */
-        {"ZABBIX_API", "http://zabbix.example.com/api_csv.php"},
-        /* NOTE: 64 char Zabbix API token. */
-        {"ZABBIX_TOKEN", "abc123"},
-        {"", ""}};
+    /* Poll now, unless a request is under way. */
+    void refresh()
+    {
+        if (m_state == ST_TRANSITION || m_state == ST_SLEEP)
+        {
+            m_state = ST_SLEEP;
+            m_deadline_us = time_us_32();
+            wake();
+        }
+    }
 
-    /* Set up the initial load of the configuration file. */
-    config_load("config.txt", default_config, 10);
+private:
+    /* How often to look at the HTTP client while it works. */
+    static constexpr uint32_t POLL_US = 10000;
+    /* Max HTTP state change timeout. */
+    static constexpr uint32_t STALL_US = 15000000;
+    /* 15 * 15 blocks is what fits on our display. */
+    static constexpr size_t MAX_ALERTS = 225;
 
-    /* Save it straight out, to preserve any defaults we put there. */
-    config_save();
+    /* Switch the clock now, not at the next governor run. */
+    void demand(sched::Governor::Level level)
+    {
+        governor.demand(sched::Governor::FETCH, level);
+        governor.update();
+    }
 
-    /* Get initial configuration. */
-    update_from_config();
+    bool expired(uint32_t now_us) const
+    {
+        return static_cast<int32_t>(m_deadline_us - now_us) < 0;
+    }
 
-    /* Init eighties super computer code. */
-    for (int y = 0; y < 32; ++y)
+    void close_request()
     {
-        for (int x = 0; x < 32; ++x)
+        if (m_request != NULL)
         {
-            lifetime[x][y] = 1.0f + ((rand() % 10) / 100.0f);
-            age[x][y] = ((rand() % 100) / 100.0f) * lifetime[x][y];
+            httpclient_close(m_request);
+            m_request = NULL;
         }
     }
 
-    /* Init display (and serial port?). */
-    cosmic_unicorn.init();
-
-    /* Wait a bit. This sleep allows you to attach a serial console
-     * (ttyACM0) to get debug info from the start. */
-    if (boot_delay)
+    /* From WARMUP_MS before the deadline: connect, without sending the
+     * request. Returns the time until we want to look again. */
+    uint32_t warm_up(uint32_t now_us)
     {
-        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1); /* enable PicoW LED */
-        usbfs_sleep_ms(boot_delay);
-        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0); /* disable PicoW LED */
+        uint32_t left_us = m_deadline_us - now_us;
+        if (m_request == NULL)
+        {
+            if (m_warmup_failed)
+            {
+                return left_us;
+            }
+            if (left_us > warmup_ms * 1000)
+            {
+                return left_us - warmup_ms * 1000;
+            }
+            m_request = httpclient_warmup2(
+                "GET", trigger_url.c_str(), NULL, 0, auth_header.c_str(),
+                NULL);
+            if (m_request == NULL)
+            {
+                m_warmup_failed = true;
+                return left_us;
+            }
+            start_reading();
+        }
+        httpclient_status_t state = httpclient_check(m_request);
+        switch (state)
+        {
+        case HTTPCLIENT_READY:
+            demand(sched::Governor::LOW);
+            return left_us;
+        case HTTPCLIENT_FAILED:
+        case HTTPCLIENT_COMPLETE:
+        case HTTPCLIENT_TRUNCATED:
+            /* Try again, from scratch, at the deadline. */
+            printf("Warm-up failed (%d)\n", state);
+            close_request();
+            m_warmup_failed = true;
+            demand(sched::Governor::LOW);
+            return left_us;
+        default:
+            /* mbedTLS does the handshake maths while we are in CONNECT. */
+            demand(
+                (state == HTTPCLIENT_CONNECT) ? sched::Governor::HIGH
+                                              : sched::Governor::NORMAL);
+            return std::min(POLL_US, left_us);
+        }
     }
 
-    /* Notify why we (re)started. */
-    if (watchdog_caused_reboot())
+    uint32_t do_request()
     {
-        printf("Rebooted by Watchdog!\n");
-        for (int i = 0; i < 5; ++i)
+        /* Set up the API request. */
+        demand(sched::Governor::NORMAL);
+        beat(time_us_32());
+        m_state = ST_WAIT_RESPONSE;
+        m_warmup_failed = false;
+        if (m_request != NULL
+            && httpclient_check(m_request) == HTTPCLIENT_FAILED)
+        {
+            /* The server dropped the warm connection since we looked. */
+            printf("Warm-up failed late\n");
+            close_request();
+        }
+        if (m_request == NULL)
         {
-            for (int lightness = 1; lightness >= 0; --lightness)
+            m_request = httpclient_open2(
+                "GET", trigger_url.c_str(), NULL, 0, auth_header.c_str(),
+                NULL);
+            if (m_request != NULL)
             {
-                graphics.set_pen(graphics.create_pen_hsv(
-                    HUE_ORANGE, 1.0, (float)lightness));
-                graphics.rectangle(Rect(0, 0, 32, 32));
-                cosmic_unicorn.update(&graphics);
-                usbfs_sleep_ms(200);
+                start_reading();
             }
         }
+        else
+        {
+            httpclient_release(m_request);
+        }
+        return POLL_US;
     }
-    else
+
+    /* Have the body of the new request parsed as it comes in, instead
+     * of buffering all of it. */
+    void start_reading()
     {
-        printf("Clean boot\n");
+        m_reader.reset();
+        m_results.clear();
+        httpclient_set_body_callback(m_request, read_body, this);
     }
 
-    /* Last update was never. */
-    last_update = millis() - updates_at_least_every;
+    static uint16_t read_body(void* context, const char* data, uint16_t len)
+    {
+        return static_cast<FetchTask*>(context)->read(data, len);
+    }
 
-    /* Enter the main program loop now. */
-    while (true)
+    /* Takes all of it: rows past MAX_ALERTS are read, but not kept. */
+    uint16_t read(const char* data, uint16_t len)
     {
-        /* Monitor the configuration file and update vars */
-        if (config_check())
+        if (m_request->http_status != 200)
         {
-            update_from_config();
+            /* An error page, not alerts. */
+            return len;
         }
-
-        /* Handle state change */
-        switch (app_state)
+        size_t left = len;
+        while (left)
         {
-        case ST_DO_REQUEST:
-            /* Set up the API request. */
-            app_state = ST_WAIT_RESPONSE;
-            if (http_request == NULL)
+            size_t taken = m_reader.feed(data, left);
+            data += taken;
+            left -= taken;
+            if (m_reader.row_ready())
             {
-                http_request = httpclient_open2(
-                    "GET", trigger_url.c_str(), NULL, 1024,
-                    auth_header.c_str(), NULL);
+                add_row(m_reader.row());
             }
-            else
+        }
+        return len;
+    }
+
+    void add_row(const zabbix::CsvReader::Row& row)
+    {
+        if (m_results.size() < MAX_ALERTS)
+        {
+            m_results.push_back(ZabbixAlert::from_row(row));
+        }
+    }
+
+    /* How long connecting took and how much of that went before the
+     * deadline, where it did not delay the answer. */
+    void report_latency()
+    {
+        if (is_nil_time(m_request->connect_time))
+        {
+            return;
+        }
+        int64_t setup_us = absolute_time_diff_us(
+            m_request->open_time, m_request->connect_time);
+        int64_t hidden_us = std::min(
+            setup_us, absolute_time_diff_us(
+                          m_request->open_time, m_request->release_time));
+        int64_t answer_us = absolute_time_diff_us(
+            m_request->release_time, get_absolute_time());
+        printf(
+            "Latency: setup %lu ms, %lu ms of it hidden; answer after %lu ms"
+            "\n",
+            (unsigned long)(setup_us / 1000),
+            (unsigned long)(hidden_us / 1000),
+            (unsigned long)(answer_us / 1000));
+        http_setup_ms.add(setup_us / 1000);
+        http_hidden_ms.add(hidden_us / 1000);
+    }
+
+    uint32_t wait_response(uint32_t now_us)
+    {
+        /* Check API response. */
+        if (m_request == NULL)
+        {
+            printf("BUG: ST_API_REQUEST: why is http_request zero?\n");
+            return POLL_US;
+        }
+        httpclient_status_t new_http_state = httpclient_check(m_request);
+        switch (new_http_state)
+        {
+        case HTTPCLIENT_NONE:
+        case HTTPCLIENT_WIFI_INIT:
+        case HTTPCLIENT_WIFI:
+            if (new_http_state != m_http_state)
             {
-                printf("BUG: ST_DO_REQUEST: http_request non-zero?\n");
+                printf(
+                    "HTTPCLIENT_* state change %d -> %d"
+                    "(no timeout)\n",
+                    m_http_state, new_http_state);
             }
+            /* The client retries joining on its own. */
+            beat(now_us);
             break;
-
-        case ST_WAIT_RESPONSE:
-            /* Check API response. */
-            if (http_request)
+        case HTTPCLIENT_DNS:
+        case HTTPCLIENT_CONNECT: // <- long TLS waits/stalls
+        case HTTPCLIENT_READY:
+        case HTTPCLIENT_REQUEST:
+        case HTTPCLIENT_RESPONSE_STATUS:
+        case HTTPCLIENT_HEADERS:
+        case HTTPCLIENT_DATA:
+            if (m_http_state == HTTPCLIENT_DNS
+                || m_http_state == HTTPCLIENT_CONNECT
+                || m_http_state == HTTPCLIENT_READY
+                || m_http_state == HTTPCLIENT_REQUEST
+                || m_http_state == HTTPCLIENT_RESPONSE_STATUS
+                || m_http_state == HTTPCLIENT_HEADERS
+                || m_http_state == HTTPCLIENT_DATA)
             {
-                httpclient_status_t new_http_state =
-                    (httpclient_check(http_request));
-                switch (new_http_state)
+                if (expired(now_us))
                 {
-                case HTTPCLIENT_NONE:
-                case HTTPCLIENT_WIFI_INIT:
-                case HTTPCLIENT_WIFI:
-                    if (new_http_state != http_state)
-                    {
-                        printf(
-                            "HTTPCLIENT_* state change %d -> %d"
-                            "(no timeout)\n",
-                            http_state, new_http_state);
-                    }
-                    break;
-                case HTTPCLIENT_DNS:
-                case HTTPCLIENT_CONNECT: // <- long TLS waits/stalls
-                case HTTPCLIENT_REQUEST:
-                case HTTPCLIENT_RESPONSE_STATUS:
-                case HTTPCLIENT_HEADERS:
-                case HTTPCLIENT_DATA:
-                    if (http_state == HTTPCLIENT_DNS
-                        || http_state == HTTPCLIENT_CONNECT
-                        || http_state == HTTPCLIENT_REQUEST
-                        || http_state == HTTPCLIENT_RESPONSE_STATUS
-                        || http_state == HTTPCLIENT_HEADERS
-                        || http_state == HTTPCLIENT_DATA)
-                    {
-                        if (is_after(wait_until))
-                        {
-                            printf("HTTPCLIENT_* timeout\n");
-                            http_status = 408; /* TIMEOUT */
-                            app_state = ST_HANDLE_RESPONSE;
-                        }
-                    }
-                    if (new_http_state != http_state)
-                    {
-                        printf(
-                            "HTTPCLIENT_* state change %d -> %d\n", http_state,
-                            new_http_state);
-                        /* Max HTTP state change timeout 15 s. */
-                        wait_until = millis() + 15000;
-                    }
-                    break;
-                case HTTPCLIENT_COMPLETE:
-                case HTTPCLIENT_TRUNCATED:
-                    // FIXME: do something with truncated response?
-                    printf(
-                        "HTTPCLIENT_COMPLETE? (%d) response code %d\n",
-                        new_http_state, http_request->http_status);
-                    http_status = http_request->http_status;
-                    http_response = std::string(
-                        httpclient_get_response(http_request),
-                        http_request->response_length);
-                    printf("Response: [[[%s]]]\n", http_response.c_str());
-                    printf("Mem free: %lu\n", mem_heap_free());
-                    httpclient_close(http_request);
-                    http_request = NULL;
-                    printf(
-                        "Mem free: %lu (after closing http)\n",
-                        mem_heap_free());
-                    app_state = ST_HANDLE_RESPONSE;
-                    break;
-                case HTTPCLIENT_FAILED:
-                    printf(
-                        "HTTPCLIENT_FAILED response code %d\n",
-                        http_request->http_status);
-                    http_status = 0;
-                    httpclient_close(http_request);
-                    http_request = NULL;
-                    app_state = ST_HANDLE_RESPONSE;
+                    printf("HTTPCLIENT_* timeout\n");
+                    http_timeouts.add(1);
+                    close_request();
+                    m_http_status = 408; /* TIMEOUT */
+                    m_state = ST_HANDLE_RESPONSE;
+                    new_http_state = HTTPCLIENT_NONE;
                     break;
                 }
-                http_state = new_http_state;
             }
-            else
+            if (new_http_state != m_http_state)
             {
-                printf("BUG: ST_API_REQUEST: why is http_request zero?\n");
+                printf(
+                    "HTTPCLIENT_* state change %d -> %d\n", m_http_state,
+                    new_http_state);
+                m_deadline_us = now_us + STALL_US;
+                beat(now_us);
             }
             break;
+        case HTTPCLIENT_COMPLETE:
+        case HTTPCLIENT_TRUNCATED:
+            // FIXME: do something with truncated response?
+            printf(
+                "HTTPCLIENT_COMPLETE? (%d) response code %d\n",
+                new_http_state, m_request->http_status);
+            m_http_status = m_request->http_status;
+            report_latency();
+            if (m_reader.finish())
+            {
+                add_row(m_reader.row());
+            }
+            printf(
+                "Response: %lu rows, %lu kept\n",
+                (unsigned long)m_reader.rows(),
+                (unsigned long)m_results.size());
+            printf("Mem free: %lu\n", mem_heap_free());
+            close_request();
+            printf("Mem free: %lu (after closing http)\n", mem_heap_free());
+            m_state = ST_HANDLE_RESPONSE;
+            break;
+        case HTTPCLIENT_FAILED:
+            printf(
+                "HTTPCLIENT_FAILED response code %d\n",
+                m_request->http_status);
+            m_http_status = 0;
+            close_request();
+            m_state = ST_HANDLE_RESPONSE;
+            break;
+        }
+        m_http_state = new_http_state;
+        /* mbedTLS does the handshake maths while we are in CONNECT. */
+        demand(
+            (new_http_state == HTTPCLIENT_CONNECT) ? sched::Governor::HIGH
+                                                   : sched::Governor::NORMAL);
+        return (m_state == ST_HANDLE_RESPONSE) ? 0 : POLL_US;
+    }
 
-        case ST_HANDLE_RESPONSE:
-            /* Handle response. */
+    uint32_t handle_response(uint32_t now_us)
+    {
+        /* Handle response; parsing is worth a faster clock. */
+        demand(sched::Governor::HIGH);
+        printf(
+            "ST_API_RESPONSE (%d): %lu alerts\n", m_http_status,
+            (unsigned long)m_results.size());
+        if (m_http_status == 200 && first_data_us == 0)
+        {
+            first_data_us = time_us_32();
             printf(
-                "ST_API_RESPONSE (%d): [[[%s]]]\n", http_status,
-                http_response.c_str());
-            if (http_status == 200)
+                "Boot: first frame after %lu ms, first data after %lu ms\n",
+                (unsigned long)first_frame_us / 1000,
+                (unsigned long)first_data_us / 1000);
+        }
+        if (m_http_status != 200)
+        {
+            /* Sucks to be you.. */
+            m_results.clear();
+            m_state = ST_SLEEP;
+            return sleep(sched::PollInterval::FAILED, now_us);
+        }
+
+        /* The rows were parsed while they came in. */
+        sched::PollInterval::Result result;
+        if (m_results == m_alerts)
+        {
+            // no change
+            printf("No changes\n");
+            result = sched::PollInterval::UNCHANGED;
+        }
+        else
+        {
+            printf("Alerts changed\n");
+            result = sched::PollInterval::CHANGED;
+        }
+        uint32_t wait_us = sleep(result, now_us);
+        m_alerts.swap(m_results);
+        m_results.clear();
+        display.blocks.clear();
+        for (const ZabbixAlert& alert : m_alerts)
+        {
+            display.blocks.push_back(
+                render::Block{alert.id(), alert.suppressed != 0});
+        }
+        display.last_update = millis();
+        display.stale_after =
+            std::max(updates_at_least_every, 2 * wait_us / 1000 + 1);
+        display.blocks_seq += 1;
+        publish_display();
+        m_state = ST_TRANSITION;
+        return POLL_US;
+    }
+
+    /* Set the deadline for the next request; returns the time until. */
+    uint32_t sleep(sched::PollInterval::Result result, uint32_t now_us)
+    {
+        demand(sched::Governor::LOW);
+        if (!m_seeded)
+        {
+            /* How long WiFi and the first request took differs enough
+             * between displays to spread their polls. */
+            poll_interval.seed(time_us_32());
+            m_seeded = true;
+        }
+        uint32_t wait_ms = poll_interval.next(result, millis());
+        printf(
+            "Next poll in %lu ms (%lu failures)\n", (unsigned long)wait_ms,
+            (unsigned long)poll_interval.failures());
+        m_deadline_us = now_us + wait_ms * 1000;
+        return wait_ms * 1000;
+    }
+
+    State m_state = ST_DO_REQUEST;
+    uint32_t m_deadline_us = 0;
+    bool m_seeded = false;
+    bool m_warmup_failed = false;
+    int m_http_state = HTTPCLIENT_NONE;
+    int m_http_status = 0;
+    httpclient_request_t* m_request = NULL;
+    zabbix::CsvReader m_reader;
+    std::vector<ZabbixAlert> m_results;
+    std::vector<ZabbixAlert> m_alerts;
+};
+
+/* GPIO interrupt, core0: queue the edge for the InputTask. The level
+ * tells which edge it was; the buttons pull the pin low. */
+void button_irq(uint gpio, uint32_t)
+{
+    uint32_t now_us = time_us_32();
+    for (uint8_t button = 0; button < BUTTONS; ++button)
+    {
+        if (button_pins[button] == gpio)
+        {
+            button_edges.push(input::Edge{button, !gpio_get(gpio), now_us});
+        }
+    }
+}
+
+/* Core0: act on the buttons. Presses act at once; a held brightness
+ * button ramps at the same pace, however busy the core is. */
+class InputTask : public sched::Task
+{
+public:
+    InputTask(FetchTask& fetch)
+        : Task("input", 3), m_fetch(fetch),
+          m_brightness_ramp(BRIGHTNESS_STEP, BRIGHTNESS_PER_SECOND)
+    {
+    }
+
+    uint32_t run(uint32_t now_us) override
+    {
+        input::Edge edge;
+        while (button_edges.pop(edge))
+        {
+            if (m_buttons[edge.button].update(edge.pressed, edge.time_us)
+                && edge.pressed)
             {
-                // clock;severity;suppressed;hostid;host;name
-                // 1733896822;5;0;12847;node1.example.com;CPU 25+% busy
-                std::vector<ZabbixAlert> results;
-                // If there are 225 rows, we have 15 * 15 blocks,
-                // which is the limit that fits on our display.
-                for (std::string::size_type i(0), len(http_response.length()),
-                     pos(0), row(0);
-                     i <= len && row <= 225; ++i)
-                {
-                    if (http_response[i] == '\n' || i == len)
-                    {
-                        if (row && (i - pos))
-                        {
-                            results.push_back(ZabbixAlert::from_csv(
-                                http_response.substr(pos, i - pos)));
-                        }
-                        row++;
-                        pos = i + 1;
-                    }
-                }
-                http_response.clear();
-                if (std::equal(results.begin(), results.end(), alerts.begin()))
-                {
-                    // no change
-                    printf("No changes\n");
-                }
-                else
-                {
-                    printf("Alerts changef\n");
-                }
-                // Replace old. We have no transitions yet.
-                alerts = results;
-                last_update = millis();
-                app_state = ST_TRANSITION;
+                press(static_cast<Button>(edge.button), edge.time_us);
             }
-            else
+        }
+
+        /* Bounce may have swallowed the last edge: while a button is
+         * down or just changed, the pin tells. */
+        bool watching = false;
+        for (int button = 0; button < BUTTONS; ++button)
+        {
+            input::Debouncer& debouncer = m_buttons[button];
+            uint32_t settled_us = now_us - debouncer.since_us();
+            if (!debouncer.pressed() && settled_us >= SETTLE_US)
             {
-                /* Sucks to be you.. */
-                http_response.clear();
-                app_state = ST_SLEEP;
-                wait_until = millis() + 10000;
+                continue;
             }
+            watching = true;
+            bool changed =
+                debouncer.update(!gpio_get(button_pins[button]), now_us);
+            if (changed && debouncer.pressed())
+            {
+                press(static_cast<Button>(button), now_us);
+            }
+            else if (debouncer.pressed())
+            {
+                hold(static_cast<Button>(button), now_us);
+            }
+        }
+        return watching ? SAMPLE_US : 1000000;
+    }
+    bool ready() const override
+    {
+        return !button_edges.empty();
+    }
+
+private:
+    /* How often to look at the pins while watching them. */
+    static constexpr uint32_t SAMPLE_US = 20000;
+    static constexpr uint32_t SETTLE_US = 2 * input::Debouncer::DEBOUNCE_US;
+    static constexpr float BRIGHTNESS_STEP = 0.02f;
+    static constexpr float BRIGHTNESS_PER_SECOND = 0.5f;
+
+    void press(Button button, uint32_t now_us)
+    {
+        switch (button_actions[button])
+        {
+        case ACT_REFRESH:
+            m_fetch.refresh();
+            break;
+        case ACT_ENGINE:
+            display.engine = (display.engine == render::BG_PIXEL)
+                                 ? render::BG_BITBOARD
+                                 : render::BG_PIXEL;
+            publish_display();
+            break;
+        case ACT_BRIGHTER:
+            adjust_brightness(m_brightness_ramp.press(now_us));
+            break;
+        case ACT_DIMMER:
+            adjust_brightness(-m_brightness_ramp.press(now_us));
+            break;
+        default:
             break;
+        }
+    }
+    void hold(Button button, uint32_t now_us)
+    {
+        if (button_actions[button] == ACT_BRIGHTER)
+        {
+            adjust_brightness(m_brightness_ramp.hold(now_us));
+        }
+        else if (button_actions[button] == ACT_DIMMER)
+        {
+            adjust_brightness(-m_brightness_ramp.hold(now_us));
+        }
+    }
+    void adjust_brightness(float delta)
+    {
+        float brightness =
+            std::min(std::max(display.brightness + delta, 0.0f), 1.0f);
+        if (brightness != display.brightness)
+        {
+            display.brightness = brightness;
+            publish_display();
+        }
+    }
 
-        case ST_TRANSITION:
-            /* Only called if we're showing a change. */
-            /* NOT IMPLEMENTED YET */
-            app_state = ST_SLEEP;
-            wait_until = millis() + 10000;
+    FetchTask& m_fetch;
+    input::Debouncer m_buttons[BUTTONS];
+    input::Ramp m_brightness_ramp;
+};
 
-        case ST_SLEEP:
-            if (is_after(wait_until))
+/* Core0: keep the alert blocks in flash for the next boot; see
+ * render/snapshot.hpp. Only when they changed, and at most every
+ * INTERVAL_US, to spare the flash. */
+class SnapshotTask : public sched::Task
+{
+public:
+    SnapshotTask() : Task("snapshot", 0)
+    {
+    }
+
+    /* Put the newest snapshot on display. Returns false if there is
+     * none. */
+    bool restore()
+    {
+        bool found = false;
+        for (uint32_t slot = 0; slot < storage_snapshot_slots(); ++slot)
+        {
+            uint32_t seq;
+            std::vector<render::Block> blocks;
+            if (render::Snapshot::decode(
+                    storage_snapshot_read(slot), render::Snapshot::MAX_SIZE,
+                    seq, blocks)
+                && (!found || static_cast<int32_t>(seq - m_seq) > 0))
             {
-                app_state = ST_DO_REQUEST;
+                m_slot = slot;
+                m_seq = seq;
+                m_blocks = blocks;
+                found = true;
             }
-            break;
         }
+        if (found)
+        {
+            display.blocks = m_blocks;
+            display.blocks_seq += 1;
+            publish_display();
+        }
+        return found;
+    }
 
-        /* Monitor +/- buttons. */
-        if (cosmic_unicorn.is_pressed(cosmic_unicorn.SWITCH_BRIGHTNESS_UP))
+    uint32_t run(uint32_t now_us) override
+    {
+        uint32_t slots = storage_snapshot_slots();
+        if (slots == 0 || display.blocks == m_blocks
+            || (m_saved && now_us - m_saved_us < INTERVAL_US))
         {
-            cosmic_unicorn.adjust_brightness(+0.01);
+            return CHECK_US;
         }
-        if (cosmic_unicorn.is_pressed(cosmic_unicorn.SWITCH_BRIGHTNESS_DOWN))
+        /* The next slot in the ring, so each wears a quarter. */
+        m_slot = (m_slot + 1) % slots;
+        m_seq += 1;
+        size_t size = render::Snapshot::encode(display.blocks, m_seq, m_buf);
+        if (storage_snapshot_write(m_slot, m_buf, size))
         {
-            cosmic_unicorn.adjust_brightness(-0.01);
+            m_blocks = display.blocks;
         }
+        m_saved = true;
+        m_saved_us = now_us;
+        return CHECK_US;
+    }
+
+private:
+    static constexpr uint32_t CHECK_US = 10000000;
+    static constexpr uint32_t INTERVAL_US = 900000000;
+
+    uint32_t m_slot = 0;
+    uint32_t m_seq = 0;
+    std::vector<render::Block> m_blocks;
+    bool m_saved = false;
+    uint32_t m_saved_us = 0;
+    /* Whole flash pages. */
+    uint8_t m_buf[(render::Snapshot::MAX_SIZE + 255) & ~255];
+};
 
-        graphics.set_pen(0, 0, 0);
-        graphics.clear();
+/* Core0: reload the configuration when CONFIG.TXT changes. */
+class ConfigTask : public sched::Task
+{
+public:
+    ConfigTask() : Task("config", 1)
+    {
+    }
 
-        /* Get info about ZabbixAlerts on display. */
-        int alerts_to_show = alerts.size();
-        float alert_sqrt = sqrt(alerts_to_show);
-        int row_col_size = static_cast<int>(std::ceil(alert_sqrt));
-        if (row_col_size <= 1)
+    uint32_t run(uint32_t) override
+    {
+        /* It only looks at the file every 10 s itself. */
+        if (config_check())
         {
-            row_col_size = 2;
+            update_from_config();
         }
-        int block_size = 31 / row_col_size;
-        /* Offset: when showing 9 alerts we want 1 pixel on all 4 sides,
-         * not 2 left and 2 below. */
-        int block_offset = (31 - (row_col_size * block_size)) / 2 + 1;
+        return 1000000;
+    }
+};
 
-        /* Lightness depends on wifi/connection state. */
-        bool has_recent_data =
-            ((millis() - last_update) < updates_at_least_every);
-        float saturation = has_recent_data ? 1.0 : 0.0;
-        float lightness = has_recent_data ? 0.6 : 0.3;
+/* Core0: run TinyUSB whenever the USB interrupt queued work. */
+class UsbTask : public sched::Task
+{
+public:
+    UsbTask() : Task("usb", 3)
+    {
+    }
 
-        /* Update eighties super computer. */
-        for (int y = 0; y < 32; ++y)
+    uint32_t run(uint32_t now_us) override
+    {
+        if (m_reconnect)
         {
-            for (int x = 0; x < 32; ++x)
+            if (static_cast<int32_t>(m_reconnect_us - now_us) > 0)
             {
-                if (age[x][y] < lifetime[x][y] * 0.3f)
-                {
-                    graphics.set_pen(graphics.create_pen_hsv(
-                        HUE_LIME, saturation, lightness));
-                    graphics.pixel(Point(x, y));
-                }
-                else if (age[x][y] < lifetime[x][y] * 0.5f)
-                {
-                    float decay = (lifetime[x][y] * 0.5f - age[x][y]) * 5.0f;
-                    graphics.set_pen(graphics.create_pen_hsv(
-                        HUE_LIME, saturation, lightness * decay));
-                    graphics.pixel(Point(x, y));
-                }
-                if (age[x][y] >= lifetime[x][y])
-                {
-                    age[x][y] = 0.0f;
-                    lifetime[x][y] = 1.0f + ((rand() % 10) / 100.0f);
-                }
-                age[x][y] += 0.01f;
+                return m_reconnect_us - now_us;
             }
+            usbfs_connect();
+            m_reconnect = false;
         }
+        usbfs_update();
+        /* Progress: TinyUSB caught up with its events. */
+        if (!usbfs_update_pending())
+        {
+            beat(now_us);
+        }
+        return 10000;
+    }
+    bool ready() const override
+    {
+        return usbfs_update_pending();
+    }
+
+    /* Drop off the bus for a moment; the host enumerates us afresh. */
+    bool restart(int attempt) override
+    {
+        printf("Restarting USB (attempt %d)\n", attempt);
+        usbfs_disconnect();
+        m_reconnect = true;
+        m_reconnect_us = time_us_32() + RECONNECT_US;
+        return true;
+    }
+
+private:
+    /* Long enough for the host to see us go. */
+    static constexpr uint32_t RECONNECT_US = 100000;
+
+    bool m_reconnect = false;
+    uint32_t m_reconnect_us = 0;
+};
+
+/* Core0: keep the watchdog happy, as long as the tasks keep running and
+ * the supervisor can restart those that stall. */
+class WatchdogTask : public sched::Task
+{
+public:
+    WatchdogTask() : Task("watchdog", 4)
+    {
+    }
+
+    uint32_t run(uint32_t) override
+    {
+        if (supervisor.healthy())
+        {
+            watchdog_update();
+        }
+        else if (!m_reported)
+        {
+            printf(
+                "Cannot restart %s, leaving it to the watchdog\n",
+                supervisor.failed()->name());
+            m_reported = true;
+        }
+        /* A quarter of the timeout, which the config may change. */
+        return watchdog_timer ? std::max(watchdog_timer * 250, 10000)
+                              : 1000000;
+    }
+
+private:
+    bool m_reported = false;
+};
+
+/* Core0: print idle and run time of both cores every stats interval. */
+class StatsTask : public sched::Task
+{
+public:
+    StatsTask() : Task("stats", 0)
+    {
+    }
+
+    uint32_t run(uint32_t now_us) override
+    {
+        uint32_t elapsed_us = now_us - m_last_us;
+        uint32_t idle_us[2] = {
+            core0_tasks.idle_us() + usbfs_idle_us(), core1_tasks.idle_us()};
+        /* In percent, without overflowing 32 bits. */
+        uint32_t per_cent = elapsed_us / 100 + 1;
+        for (int core = 0; core < 2; ++core)
+        {
+            idle_percent[core] =
+                (idle_us[core] - m_last_idle_us[core]) / per_cent;
+            m_last_idle_us[core] = idle_us[core];
+        }
+        printf(
+            "Idle: core0 %lu%%, core1 %lu%%\n",
+            (unsigned long)idle_percent[0], (unsigned long)idle_percent[1]);
+
+        uint32_t frames = frame_budget.frames();
+        uint32_t overruns = frame_budget.overruns();
+        printf(
+            "Frames: %lu, %lu over budget, quality %d (degraded %lu times)"
+            ", %lu transitions cut\n",
+            (unsigned long)(frames - m_last_frames),
+            (unsigned long)(overruns - m_last_overruns),
+            frame_budget.quality(), (unsigned long)frame_budget.degraded(),
+            (unsigned long)renderer->transitions_cut());
+        m_last_frames = frames;
+        m_last_overruns = overruns;
+
+        printf(
+            "Boot: first frame after %lu ms, first data after %lu ms\n",
+            (unsigned long)first_frame_us / 1000,
+            (unsigned long)first_data_us / 1000);
+        printf(
+            "Recovery: %lu HTTP timeouts, %lu watchdog reboots",
+            (unsigned long)http_timeouts.get(),
+            (unsigned long)watchdog_reboots);
+        for (int i = 0; i < supervisor.watched(); ++i)
+        {
+            printf(
+                ", %s %lu restarts", supervisor.task(i).name(),
+                (unsigned long)supervisor.restarts(i));
+        }
+        printf("\n");
+        printf(
+            "Warm-up: %lu of %lu ms connection setup before the deadline\n",
+            (unsigned long)http_hidden_ms.get(),
+            (unsigned long)http_setup_ms.get());
+        uint32_t connects;
+        uint32_t reuses;
+        httpclient_get_stats(&connects, &reuses);
+        uint32_t requests = connects + reuses;
+        printf(
+            "Connections: %lu made, %lu reused (%lu%% of requests)\n",
+            (unsigned long)connects, (unsigned long)reuses,
+            (unsigned long)(requests ? 100ull * reuses / requests : 0));
+        httpclient_tls_stats_t tls;
+        httpclient_get_tls_stats(&tls);
+        printf(
+            "TLS: %lu full handshakes, %lu ms each; %lu resumed, %lu ms each"
+            "\n",
+            (unsigned long)tls.full_handshakes,
+            (unsigned long)(tls.full_handshake_ms
+                            / std::max<uint32_t>(tls.full_handshakes, 1)),
+            (unsigned long)tls.resumed_handshakes,
+            (unsigned long)(tls.resumed_handshake_ms
+                            / std::max<uint32_t>(tls.resumed_handshakes, 1)));
 
-        /* Write static rectangles for all alerts. */
-        size_t alert_idx = 0;
-        for (int y = block_offset; y < block_size * row_col_size;
-             y += block_size)
+        /* Run time in per mille, also without overflowing. */
+        uint32_t per_mille = elapsed_us / 1000 + 1;
+        uint32_t at[sched::Governor::LEVELS];
+        for (int level = 0; level < sched::Governor::LEVELS; ++level)
         {
-            for (int x = block_offset; x < block_size * row_col_size;
-                 x += block_size)
+            uint32_t level_us =
+                governor.level_us(static_cast<sched::Governor::Level>(level));
+            at[level] = (level_us - m_last_level_us[level]) / per_mille;
+            m_last_level_us[level] = level_us;
+        }
+        printf(
+            "Clock: %lu MHz %lu.%lu%%, %lu MHz %lu.%lu%%, %lu MHz %lu.%lu%%"
+            " (%lu switches)\n",
+            (unsigned long)clock_khz[0] / 1000, (unsigned long)at[0] / 10,
+            (unsigned long)at[0] % 10, (unsigned long)clock_khz[1] / 1000,
+            (unsigned long)at[1] / 10, (unsigned long)at[1] % 10,
+            (unsigned long)clock_khz[2] / 1000, (unsigned long)at[2] / 10,
+            (unsigned long)at[2] % 10, (unsigned long)governor.switches());
+
+        int n = 0;
+        for (const sched::Scheduler* tasks : {&core0_tasks, &core1_tasks})
+        {
+            for (const sched::Task* task : tasks->tasks())
             {
-                if (alert_idx < alerts.size())
+                /* Tasks are never removed, so n stays with the task. */
+                if (n == MAX_TASKS)
                 {
-                    saturation = has_recent_data ? 1.0 : 0.5;
-                    lightness = has_recent_data ? 1.0 : 0.6;
-                    if (alerts[alert_idx].suppressed)
-                    {
-                        saturation = 0;
-                        lightness = 0.6;
-                    }
-                    graphics.set_pen(graphics.create_pen_hsv(
-                        HUE_RED, saturation, lightness));
-
-                    int w;
-                    for (w = x; w < x + block_size - 1; ++w)
-                    {
-                        for (int h = y; h < y + block_size - 1; ++h)
-                        {
-                            graphics.pixel(Point(w, h));
-                        }
-                    }
-
-                    alert_idx += 1;
+                    break;
                 }
+                uint32_t busy =
+                    (task->run_us() - m_last_run_us[n]) / per_mille;
+                /* XIP cache hits per mille of accesses. */
+                uint32_t accesses =
+                    task->cache_accesses() - m_last_cache_accesses[n];
+                uint32_t hits = task->cache_hits() - m_last_cache_hits[n];
+                uint32_t hit_rate =
+                    accesses ? uint64_t(hits) * 1000 / accesses : 1000;
+                printf(
+                    "Task %-8s core%d: %lu runs, %lu.%lu%%, max %lu us,"
+                    " XIP %lu.%lu%% hits of %lu k\n",
+                    task->name(), tasks == &core1_tasks,
+                    (unsigned long)(task->runs() - m_last_runs[n]),
+                    (unsigned long)(busy / 10), (unsigned long)(busy % 10),
+                    (unsigned long)task->max_us(),
+                    (unsigned long)(hit_rate / 10),
+                    (unsigned long)(hit_rate % 10),
+                    (unsigned long)(accesses / 1000));
+                m_last_runs[n] = task->runs();
+                m_last_run_us[n] = task->run_us();
+                m_last_cache_hits[n] = task->cache_hits();
+                m_last_cache_accesses[n] = task->cache_accesses();
+                ++n;
             }
         }
+        m_last_us = now_us;
+        return stats_interval_us;
+    }
+
+private:
+    static constexpr int MAX_TASKS = 12;
+
+    uint32_t m_last_us = 0;
+    uint32_t m_last_idle_us[2] = {};
+    uint32_t m_last_level_us[sched::Governor::LEVELS] = {};
+    uint32_t m_last_frames = 0;
+    uint32_t m_last_overruns = 0;
+    uint32_t m_last_runs[MAX_TASKS] = {};
+    uint32_t m_last_run_us[MAX_TASKS] = {};
+    uint32_t m_last_cache_hits[MAX_TASKS] = {};
+    uint32_t m_last_cache_accesses[MAX_TASKS] = {};
+};
+
+int main()
+{
+    /* Initialise stdio handling. */
+    stdio_init_all();
+
+    /* The USB handling and the filesystem first: the configuration says
+     * how to draw and which WiFi to join. */
+    usbfs_init();
+
+    /* Declare some default configuration details. */
+    config_t default_config[] = {
+        /* NOTE: We use the BOOT_DELAY for a delay during startup. That way
+         * way we can attach a serial console in time and check debug info. */
+        {"BOOT_DELAY", "0"},
+        /* While the HTTP code is flaky, we use the watchdog to restart.
+         * This is limited to 8388 ms. We'll cap it to 8000 ms. */
+        {"WATCHDOG_TIMER", "8000"},
+        /* Either "pixel" or "bitboard". They look the same, but the
+         * latter updates 32 pixels at a time. */
+        {"BACKGROUND_ENGINE", "pixel"},
+        /* Either "rgb888" (4 KiB frame) or "p8" (1 KiB frame, palette
+         * indexed). They look the same. Only read at boot. */
+        {"FRAME_FORMAT", "rgb888"},
+        /* Frames come every 10 ms; when they keep taking longer than
+         * this, the background slows down, then transitions are skipped,
+         * then the background freezes. */
+        {"FRAME_BUDGET_US", "8000"},
+        /* Poll Zabbix every POLL_INTERVAL ms; every POLL_FAST_INTERVAL
+         * for POLL_FAST_PERIOD after the alerts changed. After
+         * POLL_QUIET_PERIOD without changes, or on failures, back off
+         * up to POLL_MAX_INTERVAL. Each wait varies by up to
+         * POLL_JITTER_PERCENT. */
+        {"POLL_INTERVAL", "10000"},
+        {"POLL_FAST_INTERVAL", "2000"},
+        {"POLL_FAST_PERIOD", "120000"},
+        {"POLL_QUIET_PERIOD", "600000"},
+        {"POLL_MAX_INTERVAL", "120000"},
+        {"POLL_JITTER_PERCENT", "10"},
+        /* Look up the host and connect (including the TLS handshake)
+         * up to WARMUP_MS before each poll, so that the request goes
+         * out on time. Servers drop idle connections, so keep it short.
+         * 0 connects at the poll itself; at most 20000, as the HTTP
+         * client gives up on a connection held longer. */
+        {"WARMUP_MS", "2000"},
+        /* Look the Zabbix host up at most every DNS_MIN_TTL seconds,
+         * also after a failed lookup. Beyond that, the DNS record's TTL
+         * counts. While lookups fail, keep using the last good address
+         * for up to DNS_MAX_TTL seconds. */
+        {"DNS_MIN_TTL", "60"},
+        {"DNS_MAX_TTL", "86400"},
+        /* Run the system clock at CLOCK_HIGH_KHZ for TLS handshakes and
+         * parsing, at CLOCK_LOW_KHZ when idle, at 125 MHz otherwise.
+         * "off" keeps it at 125 MHz. */
+        {"CLOCK_GOVERNOR", "on"},
+        {"CLOCK_LOW_KHZ", "96000"},
+        {"CLOCK_HIGH_KHZ", "200000"},
+        /* What the A-D buttons do: "none", "refresh" (poll Zabbix now),
+         * "engine" (switch background engine until the config changes),
+         * "brighter" or "dimmer". */
+        {"BUTTON_A", "refresh"},
+        {"BUTTON_B", "engine"},
+        {"BUTTON_C", "none"},
+        {"BUTTON_D", "none"},
+        /* NOTE: There's no need to update these here! You can replace them
+         * in CONFIG.TXT after mounting the runtime mount point (usbfs!). */
+        {"WIFI_SSID", "my_network"},
+        {"WIFI_PASSWORD", "my_password"},
+        /* NOTE: We need a separate api_csv.php, as the api_jsonrpc.php
+         * requires multiple calls.
+         * NOTE: The TLS handler does not support TLS 1.3, so the side
+         * needs 1.2 or lower.
+         * NOTE: If the site has PFS the certificate needs to be ECDSA.
+         * For RSA RSA we'd need a cipher without DHE. */
+        {"ZABBIX_API", "http://zabbix.example.com/api_csv.php"},
+        /* NOTE: 64 char Zabbix API token. */
+        {"ZABBIX_TOKEN", "abc123"},
+        {"", ""}};
+
+    /* Set up the initial load of the configuration file. */
+    config_load("config.txt", default_config, 10);
+
+    /* Save it straight out, to preserve any defaults we put there. This
+     * leaves the flash alone unless something was missing. */
+    config_save();
+
+    /* The governor's NORMAL clock is the one we booted with. */
+    clock_khz[sched::Governor::NORMAL] = clock_get_hz(clk_sys) / 1000;
+
+    /* Get initial configuration. */
+    update_from_config();
+
+    /* Set up the frame buffer and its renderer. */
+    const char* frame_format = config_get("FRAME_FORMAT");
+    create_graphics(
+        (frame_format != NULL && strcmp(frame_format, "p8") == 0)
+            ? render::FRAME_P8
+            : render::FRAME_RGB888);
+
+    /* Init eighties super computer code. Both engines, so we can switch
+     * between them when the config changes. */
+    renderer->init();
+
+    /* Init display (and serial port?). */
+    cosmic_unicorn.init();
+    display.brightness = cosmic_unicorn.get_brightness();
+
+    /* The buttons report their edges by interrupt, on this core. */
+    for (uint pin : button_pins)
+    {
+        gpio_set_irq_enabled_with_callback(
+            pin, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true, button_irq);
+    }
+
+    /* Notify why we (re)started; core1 blinks for a watchdog reboot. */
+    if (watchdog_caused_reboot())
+    {
+        if (watchdog_hw->scratch[1] == WATCHDOG_REBOOTS_MAGIC)
+        {
+            watchdog_reboots = watchdog_hw->scratch[0] + 1;
+        }
+        printf(
+            "Rebooted by Watchdog! (%lu times)\n",
+            (unsigned long)watchdog_reboots);
+        rebooted_by_watchdog = true;
+    }
+    else
+    {
+        printf("Clean boot\n");
+    }
+    watchdog_hw->scratch[0] = watchdog_reboots;
+    watchdog_hw->scratch[1] = WATCHDOG_REBOOTS_MAGIC;
+
+    /* Last update was never, so the last known alerts from flash show in
+     * gray until Zabbix answers. */
+    display.last_update = millis() - updates_at_least_every;
+    display.stale_after = updates_at_least_every;
+    static SnapshotTask snapshot_task;
+    if (!snapshot_task.restore())
+    {
+        publish_display();
+    }
 
-        /* Update display and sleep a bit. */
-        cosmic_unicorn.update(&graphics);
-        usbfs_sleep_ms(10); /* instead of sleep_ms(10); */
+    /* Hand the display over to core1. From here on, core0 only talks to
+     * it through display_state. */
+    static RenderTask render_task;
+    core1_tasks.add(render_task);
+    core1_tasks.set_cache_probe(xip_cache_probe);
+    multicore_launch_core1(core1_main);
 
-        /* Update watchdog. */
-        watchdog_update();
+    /* Initialise the WiFi chipset, and start joining right away: the
+     * join runs while we get the rest going. */
+    if (cyw43_arch_init())
+    {
+        printf("Failed to initialise the WiFI chipset (cyw43)\n");
+        return 1;
+    }
+    httpclient_start_wifi();
+
+    /* Wait a bit. This sleep allows you to attach a serial console
+     * (ttyACM0) to get debug info from the start. */
+    if (boot_delay)
+    {
+        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1); /* enable PicoW LED */
+        usbfs_sleep_ms(boot_delay);
+        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0); /* disable PicoW LED */
+    }
+
+    /* Enter the main program loop now: everything else is a task. */
+    static WatchdogTask watchdog_task;
+    static UsbTask usb_task;
+    static FetchTask fetch_task;
+    static InputTask input_task(fetch_task);
+    static ConfigTask config_task;
+    static StatsTask stats_task;
+    supervisor.watch(fetch_task, FETCH_TIMEOUT_US);
+    supervisor.watch(usb_task, USB_TIMEOUT_US);
+    supervisor.watch(render_task, RENDER_TIMEOUT_US);
+    core0_tasks.set_cache_probe(xip_cache_probe);
+    core0_tasks.add(watchdog_task);
+    core0_tasks.add(supervisor);
+    core0_tasks.add(usb_task);
+    core0_tasks.add(input_task);
+    core0_tasks.add(fetch_task);
+    core0_tasks.add(governor);
+    core0_tasks.add(config_task);
+    core0_tasks.add(snapshot_task);
+    core0_tasks.add(stats_task);
+    while (true)
+    {
+        core0_tasks.run_for(1000000, wait_for_event);
     }
 
     /* We never get here. */
@@ -27,6 +27,8 @@
 #define MBEDTLS_PKCS1_V15
 #define MBEDTLS_SHA256_SMALLER
 #define MBEDTLS_SSL_SERVER_NAME_INDICATION
+/* Reconnects resume the session; by ticket if the server does those. */
+#define MBEDTLS_SSL_SESSION_TICKETS
 #define MBEDTLS_AES_C
 #define MBEDTLS_ASN1_PARSE_C
 #define MBEDTLS_BIGNUM_C
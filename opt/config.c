@@ -116,6 +116,47 @@ static void config_fetch( void )
 }
 
 
+/*
+ * unchanged - true if the stored file already holds exactly what save
+ *             would write; flash writes are slow and wear it out.
+ */
+
+static bool config_unchanged( void )
+{
+  usbfs_file_t *l_fileptr;
+  char          l_buffer[128];
+  char          l_stored[128];
+  uint_fast8_t  l_index;
+  bool          l_unchanged = true;
+
+  /* No file, no match. */
+  l_fileptr = usbfs_open( m_config_filename, "r" );
+  if ( l_fileptr == NULL )
+  {
+    return false;
+  }
+
+  /* Compare line by line, as save would format them. */
+  for ( l_index = 0; l_index < m_config_count && l_unchanged; l_index++ )
+  {
+    snprintf( l_buffer, 127, "%s: %s\n",
+              m_config_settings[l_index].name,
+              m_config_settings[l_index].value );
+    l_unchanged = ( usbfs_gets( l_stored, 127, l_fileptr ) != NULL ) &&
+                  ( strcmp( l_buffer, l_stored ) == 0 );
+  }
+
+  /* And nothing more after that. */
+  if ( l_unchanged && usbfs_gets( l_stored, 127, l_fileptr ) != NULL )
+  {
+    l_unchanged = false;
+  }
+
+  usbfs_close( l_fileptr );
+  return l_unchanged;
+}
+
+
 /* Public functions. */
 
 /*
@@ -171,6 +212,7 @@ void config_load( const char *p_filename,
 /*
  * save - writes the configuration settings to the stored file. These new values
  *        will overwrite any existing content, and will include any defaults.
+ *        If the file already says just that, it is left alone.
  */
 
 bool config_save( void )
@@ -179,6 +221,12 @@ bool config_save( void )
   char          l_buffer[128];
   uint_fast8_t  l_index;
 
+  /* Nothing to write? */
+  if ( config_unchanged() )
+  {
+    return true;
+  }
+
   /* Open up the file (if we can) */
   l_fileptr = usbfs_open( m_config_filename, "w" );
   if ( l_fileptr == NULL )
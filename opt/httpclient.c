@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 
 /* SDK header files. */
@@ -27,11 +28,13 @@
 #include "lwip/altcp_tcp.h"
 #include "lwip/altcp_tls.h"
 #include "lwip/dns.h"
+#include "mbedtls/ssl.h"
 
 
 /* Local header files. */
 
 #include "httpclient.h"
+#include "placement.h"
 
 
 /* Module variables. */
@@ -39,6 +42,52 @@
 static char         m_wifi_ssid[PCBP_HTTP_SSID_MAXLEN+1];
 static char         m_wifi_password[PCBP_HTTP_PASSWORD_MAXLEN+1];
 
+/*
+ * The connection is kept alive between requests to the same server; one
+ * request at a time uses it. While idle, its pcb has no request as arg.
+ */
+static struct
+{
+  char                  host[PCBP_HTTP_HOST_MAXLEN+1];
+  uint16_t              port;
+  bool                  tls;
+  struct altcp_pcb     *pcb;
+  httpclient_request_t *request;
+  absolute_time_t       idle_time;
+}                   m_connection;
+static uint32_t     m_connects;
+static uint32_t     m_reuses;
+
+/*
+ * One TLS config for all connections, and the session of the last full
+ * handshake, which the next connection to that server offers to resume.
+ */
+static struct altcp_tls_config *m_tls_config;
+static struct
+{
+  char                  host[PCBP_HTTP_HOST_MAXLEN+1];
+  uint16_t              port;
+  mbedtls_ssl_session   session;
+  bool                  valid;
+}                   m_tls_session;
+static httpclient_tls_stats_t m_tls_stats;
+
+/*
+ * The address of the last host looked up. lwIP does not tell the record's
+ * TTL, but its own cache honours it; this one saves asking for a while,
+ * and keeps the last good address for when DNS fails.
+ */
+static struct
+{
+  char                  host[PCBP_HTTP_HOST_MAXLEN+1];
+  ip_addr_t             addr;
+  bool                  valid;
+  absolute_time_t       good_time;
+  absolute_time_t       failed_until;
+}                   m_resolver;
+static uint32_t     m_dns_min_secs = PCBP_HTTP_DNS_MIN_SECS;
+static uint32_t     m_dns_max_secs = PCBP_HTTP_DNS_MAX_SECS;
+
 
 /* Functions. */
 
@@ -51,41 +100,54 @@ static char         m_wifi_password[PCBP_HTTP_PASSWORD_MAXLEN+1];
 
 
 /*
- * close_pcb - shuts down and de-allocates the pcb; this ends the network
- *             side of the conversation, but leaves the request object available
- *             for clients to extract data from.
+ * forget_connection - clears the kept-alive connection, and the pcb of the
+ *                     request using it, without touching the pcb itself;
+ *                     for when lwIP already freed it.
  */
 
-static err_t httpclient_close_pcb( httpclient_request_t *p_request )
+static void httpclient_forget_connection( void )
 {
-  err_t l_retval = ERR_OK;
-
-  /* Sanity check the request. */
-  if ( p_request == NULL )
+  if ( m_connection.request != NULL )
   {
-    return ERR_OK;
+    m_connection.request->pcb = NULL;
   }
+  m_connection.request = NULL;
+  m_connection.pcb = NULL;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * drop_connection - shuts down and de-allocates the kept-alive pcb, if any.
+ */
+
+static err_t httpclient_drop_connection( void )
+{
+  struct altcp_pcb *l_pcb = m_connection.pcb;
+  err_t             l_retval = ERR_OK;
 
   /* Only need to work if the pcb is allocated. */
-  if ( p_request->pcb != NULL )
+  if ( l_pcb != NULL )
   {
     /* Remove the callback pointers. */
-    altcp_arg( p_request->pcb, NULL );
-    altcp_recv( p_request->pcb, NULL );
-    altcp_err( p_request->pcb, NULL );
-    altcp_poll( p_request->pcb, NULL, 0 );
+    altcp_arg( l_pcb, NULL );
+    altcp_recv( l_pcb, NULL );
+    altcp_err( l_pcb, NULL );
+    altcp_poll( l_pcb, NULL, 0 );
 
     /* And close the pcb itself */
-    if ( altcp_close( p_request->pcb ) != ERR_OK )
+    if ( altcp_close( l_pcb ) != ERR_OK )
     {
       /* Abort the connection, remembering to let the caller know! */
       printf( "Failed to close pcb!\n" );
-      altcp_abort( p_request->pcb );
+      altcp_abort( l_pcb );
       l_retval = ERR_ABRT;
     }
 
     /* All cleared. */
-    p_request->pcb = NULL;
+    httpclient_forget_connection();
   }
 
   /* All done. */
@@ -94,49 +156,259 @@ static err_t httpclient_close_pcb( httpclient_request_t *p_request )
 
 
 /*
- * connect_callback - called once the connection is established.
+ * close_pcb - shuts down and de-allocates the pcb; this ends the network
+ *             side of the conversation, but leaves the request object available
+ *             for clients to extract data from.
  */
 
-static err_t httpclient_connect_callback( void *p_request,
-                                          struct altcp_pcb *p_pcb, err_t p_err )
+static err_t httpclient_close_pcb( httpclient_request_t *p_request )
 {
-  httpclient_request_t *l_request = (httpclient_request_t *)p_request;
-  err_t                 l_retval;
+  /* Sanity check the request. */
+  if ( p_request == NULL )
+  {
+    return ERR_OK;
+  }
 
-  /* Check that the error code is clear. */
-  if ( p_err != ERR_OK )
+  /* Only the request using the connection has a pcb. */
+  if ( p_request->pcb != NULL )
   {
-    printf( "connect callback with error - %d\n", l_retval );
-    l_request->status = HTTPCLIENT_FAILED;
-    return httpclient_close_pcb( l_request );
+    return httpclient_drop_connection();
   }
 
+  /* All done. */
+  return ERR_OK;
+}
+
+
+/*
+ * idle_connection - detaches a finished request from the connection, which
+ *                   stays up for the next request if the server agrees.
+ */
+
+static err_t httpclient_idle_connection( httpclient_request_t *p_request )
+{
+  /* The server will close it, or the request ended early. */
+  if ( !p_request->keep_alive || p_request->pcb == NULL )
+  {
+    return httpclient_close_pcb( p_request );
+  }
+
+  altcp_arg( p_request->pcb, NULL );
+  p_request->pcb = NULL;
+  m_connection.request = NULL;
+  m_connection.idle_time = get_absolute_time();
+
+  /* All done. */
+  return ERR_OK;
+}
+
+
+/*
+ * lost_connection - the connection went away under a request, which then
+ *                   gets p_status. But servers close kept-alive connections
+ *                   when they think they idled too long, possibly while our
+ *                   request is on its way; if it has not been answered, it
+ *                   is retried on a new connection.
+ */
+
+static err_t httpclient_lost_connection( httpclient_request_t *p_request,
+                                         httpclient_status_t p_status )
+{
+  err_t l_retval;
+
+  l_retval = httpclient_close_pcb( p_request );
+
+  /* Half a response from that connection is of no use on the next. */
+  if ( p_request->head != NULL )
+  {
+    pbuf_free( p_request->head );
+    p_request->head = NULL;
+  }
+
+  if ( p_request->reused &&
+       ( ( p_request->status == HTTPCLIENT_READY ) ||
+         ( p_request->status == HTTPCLIENT_RESPONSE_STATUS ) ) )
+  {
+    /* Picked up by httpclient_check. */
+    p_request->retry = true;
+    p_request->status = HTTPCLIENT_CONNECT;
+  }
+  else if ( p_request->status == HTTPCLIENT_READY )
+  {
+    /* Held, so the server gave up on us before we asked anything. */
+    p_request->status = HTTPCLIENT_FAILED;
+  }
+  else
+  {
+    p_request->status = p_status;
+  }
+
+  /* All done. */
+  return l_retval;
+}
+
+
+/*
+ * forget_session - drops the cached TLS session, e.g. after a handshake that
+ *                  failed; the next one is a full handshake.
+ */
+
+static void httpclient_forget_session( void )
+{
+  if ( m_tls_session.valid )
+  {
+    mbedtls_ssl_session_free( &m_tls_session.session );
+    m_tls_session.valid = false;
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * offer_session - before the handshake, offers the server to resume the
+ *                 cached session, if it is for this server.
+ */
+
+static void httpclient_offer_session( httpclient_request_t *p_request )
+{
+  if ( m_tls_session.valid &&
+       ( strcmp( m_tls_session.host, p_request->host ) == 0 ) &&
+       ( m_tls_session.port == p_request->port ) )
+  {
+    mbedtls_ssl_set_session( altcp_tls_context( p_request->pcb ),
+                             &m_tls_session.session );
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * save_session - after the handshake, counts it as full or resumed and
+ *                caches the session. A server that resumes echoes the
+ *                session ID we offered.
+ */
+
+static void httpclient_save_session( httpclient_request_t *p_request )
+{
+  mbedtls_ssl_session l_session;
+  uint32_t            l_handshake_ms;
+  bool                l_resumed;
+
+  l_handshake_ms = absolute_time_diff_us( p_request->connect_start_time,
+                                          p_request->connect_time ) / 1000;
+
+  mbedtls_ssl_session_init( &l_session );
+  if ( mbedtls_ssl_get_session( altcp_tls_context( p_request->pcb ),
+                                &l_session ) != 0 )
+  {
+    mbedtls_ssl_session_free( &l_session );
+    httpclient_forget_session();
+    return;
+  }
+
+  l_resumed = m_tls_session.valid &&
+              ( strcmp( m_tls_session.host, p_request->host ) == 0 ) &&
+              ( l_session.id_len != 0 ) &&
+              ( l_session.id_len == m_tls_session.session.id_len ) &&
+              ( memcmp( l_session.id, m_tls_session.session.id,
+                        l_session.id_len ) == 0 );
+  if ( l_resumed )
+  {
+    m_tls_stats.resumed_handshakes++;
+    m_tls_stats.resumed_handshake_ms += l_handshake_ms;
+  }
+  else
+  {
+    m_tls_stats.full_handshakes++;
+    m_tls_stats.full_handshake_ms += l_handshake_ms;
+  }
+  printf( "TLS handshake (%s) in %lu ms\n", l_resumed ? "resumed" : "full",
+          (unsigned long)l_handshake_ms );
+
+  /* The cache takes over the session and what it points to. */
+  httpclient_forget_session();
+  strcpy( m_tls_session.host, p_request->host );
+  m_tls_session.port = p_request->port;
+  m_tls_session.session = l_session;
+  m_tls_session.valid = true;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * send_request - sends the request down an established connection.
+ */
+
+static err_t httpclient_send_request( httpclient_request_t *p_request )
+{
+  err_t                 l_retval;
+
   /* Construct our request. */
-  l_request->status = HTTPCLIENT_REQUEST;
+  p_request->status = HTTPCLIENT_REQUEST;
 
   /* Send it to the remote server. */
-  l_retval = altcp_write( l_request->pcb, l_request->send_buffer,
-                          l_request->send_buffer_len, TCP_WRITE_FLAG_COPY );
+  l_retval = altcp_write( p_request->pcb, p_request->send_buffer,
+                          p_request->send_buffer_len, TCP_WRITE_FLAG_COPY );
   if ( l_retval != ERR_OK )
   {
     printf( "altcp_write() failed - %d\n", l_retval );
-    l_request->status = HTTPCLIENT_FAILED;
-    return httpclient_close_pcb( l_request );
+    p_request->status = HTTPCLIENT_FAILED;
+    return httpclient_close_pcb( p_request );
   }
 
   /* Ask to send (not sure this is necessary, but...) */
-  altcp_output( l_request->pcb );
+  altcp_output( p_request->pcb );
 
-  /* Free mem we're not using anymore. */
-  free( l_request->send_buffer );
-  l_request->send_buffer = NULL;
+  /* The send buffer stays, in case we have to retry. */
 
   /* And so we're waiting on the response code. */
-  l_request->status = HTTPCLIENT_RESPONSE_STATUS;
+  p_request->status = HTTPCLIENT_RESPONSE_STATUS;
   return ERR_OK;
 }
 
 
+/*
+ * connect_callback - called once the connection is established (for TLS,
+ *                    after the handshake).
+ */
+
+static err_t httpclient_connect_callback( void *p_request,
+                                          struct altcp_pcb *p_pcb, err_t p_err )
+{
+  httpclient_request_t *l_request = (httpclient_request_t *)p_request;
+
+  /* Check that the error code is clear. */
+  if ( p_err != ERR_OK )
+  {
+    printf( "connect callback with error - %d\n", p_err );
+    l_request->status = HTTPCLIENT_FAILED;
+    return httpclient_close_pcb( l_request );
+  }
+  l_request->connect_time = get_absolute_time();
+
+  /* A new TLS connection has just done its handshake. */
+  if ( l_request->tls && !l_request->reused )
+  {
+    httpclient_save_session( l_request );
+  }
+
+  /* A held request waits for httpclient_release. */
+  if ( l_request->held )
+  {
+    l_request->status = HTTPCLIENT_READY;
+    return ERR_OK;
+  }
+
+  return httpclient_send_request( l_request );
+}
+
+
 /*
  * connect - once we have the host's address, this initiates the connection.
  */
@@ -147,6 +419,7 @@ static err_t httpclient_connect( httpclient_request_t *p_request, ip_addr_t *p_a
 
   /* Fairly simple call into the library call; handle any error. */
   p_request->status = HTTPCLIENT_CONNECT;
+  p_request->connect_start_time = get_absolute_time();
   l_retval = altcp_connect( p_request->pcb, p_addr,
                             p_request->port, httpclient_connect_callback );
   if ( l_retval != ERR_OK )
@@ -160,24 +433,117 @@ static err_t httpclient_connect( httpclient_request_t *p_request, ip_addr_t *p_a
 }
 
 
+/*
+ * header_has_token - whether a comma separated header value holds p_token;
+ *                    like header names, these tokens ignore case.
+ */
+
+static bool httpclient_header_has_token( char *p_value, const char *p_token )
+{
+  char *l_token;
+
+  for ( l_token = strtok( p_value, ", \t" ); l_token != NULL;
+        l_token = strtok( NULL, ", \t" ) )
+  {
+    if ( strcasecmp( l_token, p_token ) == 0 )
+    {
+      return true;
+    }
+  }
+
+  /* All done. */
+  return false;
+}
+
+
+/*
+ * parse_header - picks what we need from a single "Name: value" header line.
+ */
+
+static void httpclient_parse_header( httpclient_request_t *p_request,
+                                     char *p_line )
+{
+  char *l_value;
+
+  /* Split the name from the value. */
+  l_value = strchr( p_line, ':' );
+  if ( l_value == NULL )
+  {
+    return;
+  }
+  *l_value++ = '\0';
+
+  if ( strcasecmp( p_line, "Content-Length" ) == 0 )
+  {
+    printf( "Found header: 'Content-Length:%s'\n", l_value );
+    p_request->content_length = strtoul( l_value, NULL, 10 );
+  }
+  else if ( strcasecmp( p_line, "Connection" ) == 0 )
+  {
+    /* The server may close the connection after this response. */
+    if ( httpclient_header_has_token( l_value, "close" ) )
+    {
+      p_request->keep_alive = false;
+    }
+  }
+  else if ( strcasecmp( p_line, "Transfer-Encoding" ) == 0 )
+  {
+    p_request->chunked = httpclient_header_has_token( l_value, "chunked" );
+  }
+
+  /* All done. */
+  return;
+}
+
+
 /*
  * recv_callback - called whenever data is received from the server.
  */
 
+HOT_PATH("http")
 static err_t httpclient_recv_callback( void *p_request, struct altcp_pcb *p_pcb,
                                        struct pbuf *p_buf, err_t p_error )
 {
   httpclient_request_t *l_request = (httpclient_request_t *)p_request;
-  u16_t                 l_eolptr, l_clptr, l_eohptr;
-  uint16_t              l_line_length, l_data_length, l_to_read, l_bytes_read;
+  u16_t                 l_eolptr, l_lineptr, l_eohptr;
+  uint16_t              l_line_length;
   char                 *l_charptr;
-  bool                  l_truncated;
+
+  /* On an idle connection, expect nothing but the server closing it. */
+  if ( l_request == NULL )
+  {
+    if ( p_buf != NULL )
+    {
+      altcp_recved( p_pcb, p_buf->tot_len );
+      pbuf_free( p_buf );
+    }
+    return httpclient_drop_connection();
+  }
 
   /* A NULL pbuf indicates the connection is terminating. */
   if ( p_buf == NULL )
   {
-    l_request->status = HTTPCLIENT_COMPLETE;
-    return httpclient_close_pcb( l_request );
+    /* What came of the body still gets handed over. */
+    if ( l_request->status == HTTPCLIENT_DATA )
+    {
+      l_request->body_closed = true;
+      return httpclient_close_pcb( l_request );
+    }
+    return httpclient_lost_connection( l_request, HTTPCLIENT_COMPLETE );
+  }
+
+  /*
+   * The status line and headers may come in pieces: hold on to them, unread
+   * and unacknowledged, until they are complete. Each byte is acknowledged
+   * once, when it is consumed.
+   */
+  if ( ( ( l_request->status == HTTPCLIENT_RESPONSE_STATUS ) ||
+         ( l_request->status == HTTPCLIENT_HEADERS ) ) &&
+       ( l_request->head != NULL ) )
+  {
+    pbuf_cat( l_request->head, p_buf );
+    p_buf = l_request->head;
+    l_request->head = NULL;
   }
 
   /* Process appropriately then, depending on where we are in the datastream. */
@@ -208,19 +574,36 @@ static err_t httpclient_recv_callback( void *p_request, struct altcp_pcb *p_pcb,
           /* This word is the HTTP response code. */
           l_request->http_status = atoi( l_charptr );
 
-          /* Consume the line. */
-          altcp_recved( p_pcb, l_line_length+2 );
+          /* HTTP/1.1 keeps the connection, unless a header says otherwise. */
+          l_request->keep_alive =
+            ( strcmp( l_request->header_buffer, "HTTP/1.1" ) == 0 );
 
           /* And update the status to indicate we now want headers. */
           l_request->status = HTTPCLIENT_HEADERS;
         }
       }
+
+      if ( l_request->status != HTTPCLIENT_HEADERS )
+      {
+        printf( "Bad response status line\n" );
+        pbuf_free( p_buf );
+        l_request->status = HTTPCLIENT_FAILED;
+        return httpclient_close_pcb( l_request );
+      }
+
+      /*
+       * Consume the line, but not its CRLF: the header block then starts
+       * with one, so each header follows a CRLF, and "\r\n\r\n" ends the
+       * block even if it holds no headers at all.
+       */
+      altcp_recved( p_pcb, l_eolptr );
+      p_buf = pbuf_free_header( p_buf, l_eolptr );
     }
   }
 
-  if ( l_request->status == HTTPCLIENT_HEADERS )
+  if ( ( l_request->status == HTTPCLIENT_HEADERS ) && ( p_buf != NULL ) )
   {
-    l_request->content_length = (uint16_t)-1;
+    l_request->content_length = (uint32_t)-1;
 
     /*
      * A status of HEADERS means we have a response code, so now we wait
@@ -229,56 +612,41 @@ static err_t httpclient_recv_callback( void *p_request, struct altcp_pcb *p_pcb,
     l_eohptr = pbuf_memfind( p_buf, "\r\n\r\n", 4, 0 );
     if ( l_eohptr != 0xFFFF )
     {
-      /* Excellent; we have the headers so look for the content length. */
-      l_clptr = pbuf_memfind( p_buf, "Content-Length", 14, 0 );
-      if ( l_clptr != 0xFFFF )
+      /*
+       * Excellent; we have the headers, so go through them a line at a time.
+       * Each follows a CRLF, and the one at the end of the block ends the last.
+       */
+      l_request->chunked = false;
+      for ( l_lineptr = 2; l_lineptr <= l_eohptr; l_lineptr = l_eolptr+2 )
       {
-        /* Find the end of that particular header line. */
-        l_eolptr = pbuf_memfind( p_buf, "\r\n", 2, l_clptr );
-        if ( l_eolptr != 0xFFFF )
+        l_eolptr = pbuf_memfind( p_buf, "\r\n", 2, l_lineptr );
+        l_line_length = l_eolptr - l_lineptr;
+        if ( l_line_length > PCBP_HEADER_BUFSIZE )
         {
-          /* Extract that line. */
-          pbuf_copy_partial( p_buf, l_request->header_buffer, l_eolptr-l_clptr, l_clptr );
-          l_request->header_buffer[l_eolptr-l_clptr] = '\0';
-          printf( "Found header: '%s'\n", l_request->header_buffer );
-
-          /* Find the dividing colon; the length follows. */
-          l_charptr = strchr( l_request->header_buffer, ':' );
-          if ( l_charptr != NULL )
-          {
-            l_request->content_length = atoi( l_charptr+1 );
-          }
+          l_line_length = PCBP_HEADER_BUFSIZE;
         }
+        pbuf_copy_partial( p_buf, l_request->header_buffer, l_line_length, l_lineptr );
+        l_request->header_buffer[l_line_length] = '\0';
+        httpclient_parse_header( l_request, l_request->header_buffer );
+      }
+
+      /* A chunked body carries its own lengths, whatever else is said. */
+      if ( l_request->chunked )
+      {
+        l_request->content_length = (uint32_t)-1;
+        l_request->chunk_state = HTTPCLIENT_CHUNK_SIZE_START;
+        l_request->chunk_left = 0;
       }
 
       /* Check we have a content length; if not, we're not going to get far. */
-      if ( l_request->content_length == (uint16_t)-1 )
+      else if ( l_request->content_length == (uint32_t)-1 )
       {
         printf( "Content-length not received\n" );
+        pbuf_free( p_buf );
         l_request->status = HTTPCLIENT_FAILED;
         return httpclient_close_pcb( l_request );
       }
 
-      /* If the response buffer is not allocated, allocate it. */
-      if ( l_request->response == NULL )
-      {
-        /* Work out how much data we will read; potentially capped. */
-        l_data_length = ( l_request->response_max_size < l_request->content_length ) ?
-                          l_request->response_max_size : l_request->content_length;
-        /* Grab the memory. */
-        l_request->response = (char *)malloc( l_data_length+1 );
-        if ( l_request->response == NULL )
-        {
-          printf( "Unable to allocated %d bytes for response buffer\n", l_data_length+1 );
-          l_request->status = HTTPCLIENT_FAILED;
-          return httpclient_close_pcb( l_request );
-        }
-
-        /* And remember we did so. */
-        l_request->response_allocated = true;
-        l_request->response_length = 0;
-      }
-
       /* We have, so consume the headers and start working on the data. */
       altcp_recved( p_pcb, l_eohptr+4 );
       p_buf = pbuf_free_header( p_buf, l_eohptr+4 );
@@ -286,83 +654,502 @@ static err_t httpclient_recv_callback( void *p_request, struct altcp_pcb *p_pcb,
     }
   }
 
-  if ( l_request->status == HTTPCLIENT_DATA )
+  /* Not complete yet; wait for more, within reason. */
+  if ( ( ( l_request->status == HTTPCLIENT_RESPONSE_STATUS ) ||
+         ( l_request->status == HTTPCLIENT_HEADERS ) ) && ( p_buf != NULL ) )
+  {
+    if ( p_buf->tot_len > PCBP_HEADERS_MAXLEN )
+    {
+      printf( "Response headers too long\n" );
+      pbuf_free( p_buf );
+      l_request->status = HTTPCLIENT_FAILED;
+      return httpclient_close_pcb( l_request );
+    }
+    l_request->head = p_buf;
+    p_buf = NULL;
+  }
+
+  if ( ( l_request->status == HTTPCLIENT_DATA ) && ( p_buf != NULL ) )
   {
     /*
-     * A status of DATA means we're now receiving the body data. We keep reading
-     * until we hit our content length, or the maximum response size if smaller.
+     * A status of DATA means we're now receiving the body data. It is queued
+     * for httpclient_check to hand over, and only acknowledged once taken;
+     * so a consumer that falls behind closes the TCP window on the server.
      */
-    l_truncated = false;
-    l_to_read = p_buf->tot_len;
-    if ( ( l_request->response_length + l_to_read ) > l_request->response_max_size )
+    if ( l_request->body == NULL )
+    {
+      l_request->body = p_buf;
+    }
+    else
+    {
+      pbuf_cat( l_request->body, p_buf );
+    }
+  }
+  else if ( p_buf != NULL )
+  {
+    /* Nothing we expect in this state; take it and drop it. */
+    altcp_recved( p_pcb, p_buf->tot_len );
+    pbuf_free( p_buf );
+  }
+
+  /* All done, return we are happy. */
+  return ERR_OK;
+}
+
+
+/*
+ * consume_body - passes body data to the body callback; without one, copies
+ *                it into the response buffer, as far as that goes. Returns
+ *                how much was taken.
+ */
+
+static uint16_t httpclient_consume_body( httpclient_request_t *p_request,
+                                         const char *p_data, uint16_t p_length )
+{
+  uint16_t l_size;
+
+  if ( p_request->body_callback != NULL )
+  {
+    return p_request->body_callback( p_request->body_context, p_data, p_length );
+  }
+
+  /* Work out how much data we will read; potentially capped. */
+  l_size = ( p_request->response_max_size < p_request->content_length ) ?
+             p_request->response_max_size : p_request->content_length;
+
+  /* If the response buffer is not allocated, allocate it. */
+  if ( p_request->response == NULL )
+  {
+    p_request->response = (char *)malloc( l_size+1 );
+    if ( p_request->response == NULL )
+    {
+      printf( "Unable to allocated %d bytes for response buffer\n", l_size+1 );
+      p_request->status = HTTPCLIENT_FAILED;
+      return 0;
+    }
+
+    /* And remember we did so. */
+    p_request->response_allocated = true;
+    p_request->response_length = 0;
+  }
+
+  /* Phew; now read ... however much we think we want. */
+  if ( p_length > l_size - p_request->response_length )
+  {
+    p_length = l_size - p_request->response_length;
+  }
+  memcpy( p_request->response+p_request->response_length, p_data, p_length );
+  p_request->response_length += p_length;
+
+  /* All done. */
+  return p_length;
+}
+
+
+/*
+ * take_chunked - decodes a chunked body, passing the chunk data on to the
+ *                consumer. Returns how much of the encoded data was taken.
+ */
+
+HOT_PATH("http")
+static uint16_t httpclient_take_chunked( httpclient_request_t *p_request,
+                                         const char *p_data, uint16_t p_length )
+{
+  uint16_t l_offset = 0;
+  uint16_t l_length;
+  uint16_t l_taken;
+  char     l_char;
+  int      l_digit;
+
+  while ( ( l_offset < p_length ) &&
+          ( p_request->status == HTTPCLIENT_DATA ) &&
+          ( p_request->chunk_state != HTTPCLIENT_CHUNK_DONE ) )
+  {
+    /* Chunk data goes to the consumer, as much of it as it takes. */
+    if ( p_request->chunk_state == HTTPCLIENT_CHUNK_DATA )
+    {
+      l_length = p_length - l_offset;
+      if ( l_length > p_request->chunk_left )
+      {
+        l_length = p_request->chunk_left;
+      }
+      l_taken = httpclient_consume_body( p_request, p_data+l_offset, l_length );
+      p_request->body_length += l_taken;
+      p_request->chunk_left -= l_taken;
+      l_offset += l_taken;
+      if ( p_request->chunk_left == 0 )
+      {
+        p_request->chunk_state = HTTPCLIENT_CHUNK_DATA_END;
+      }
+      if ( l_taken < l_length )
+      {
+        break;
+      }
+      continue;
+    }
+
+    /* The rest is read a character at a time: "<hex>[;ext]\r\n", the
+     * "\r\n" after the data and the trailer after the last, empty chunk. */
+    l_char = p_data[l_offset++];
+    if ( l_char == '\r' && p_request->chunk_state != HTTPCLIENT_CHUNK_SIZE_START )
+    {
+      continue;
+    }
+    l_digit = ( l_char >= '0' && l_char <= '9' ) ? l_char - '0' :
+              ( l_char >= 'a' && l_char <= 'f' ) ? l_char - 'a' + 10 :
+              ( l_char >= 'A' && l_char <= 'F' ) ? l_char - 'A' + 10 : -1;
+
+    switch( p_request->chunk_state )
+    {
+      case HTTPCLIENT_CHUNK_SIZE_START:
+      case HTTPCLIENT_CHUNK_SIZE:
+        if ( ( l_digit >= 0 ) && ( p_request->chunk_left <= 0x0FFFFFFF ) )
+        {
+          p_request->chunk_left = p_request->chunk_left * 16 + l_digit;
+          p_request->chunk_state = HTTPCLIENT_CHUNK_SIZE;
+          break;
+        }
+        if ( p_request->chunk_state == HTTPCLIENT_CHUNK_SIZE_START ||
+             l_digit >= 0 )
+        {
+          printf( "Bad chunk size\n" );
+          p_request->status = HTTPCLIENT_FAILED;
+          break;
+        }
+        if ( l_char != '\n' )
+        {
+          p_request->chunk_state = HTTPCLIENT_CHUNK_EXTENSION;
+          break;
+        }
+        /* fall through */
+      case HTTPCLIENT_CHUNK_EXTENSION:
+        if ( l_char == '\n' )
+        {
+          p_request->chunk_state = ( p_request->chunk_left == 0 ) ?
+            HTTPCLIENT_CHUNK_TRAILER_START : HTTPCLIENT_CHUNK_DATA;
+        }
+        break;
+      case HTTPCLIENT_CHUNK_DATA_END:
+        if ( l_char != '\n' )
+        {
+          printf( "Bad chunk end\n" );
+          p_request->status = HTTPCLIENT_FAILED;
+          break;
+        }
+        p_request->chunk_state = HTTPCLIENT_CHUNK_SIZE_START;
+        break;
+      case HTTPCLIENT_CHUNK_TRAILER_START:
+        p_request->chunk_state = ( l_char == '\n' ) ?
+          HTTPCLIENT_CHUNK_DONE : HTTPCLIENT_CHUNK_TRAILER;
+        break;
+      case HTTPCLIENT_CHUNK_TRAILER:
+        if ( l_char == '\n' )
+        {
+          p_request->chunk_state = HTTPCLIENT_CHUNK_TRAILER_START;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* All done. */
+  return l_offset;
+}
+
+
+/*
+ * deliver_body - hands the queued body over, and acknowledges what was
+ *                taken; the rest waits for the next httpclient_check.
+ */
+
+HOT_PATH("http")
+static void httpclient_deliver_body( httpclient_request_t *p_request )
+{
+  struct pbuf *l_body;
+  struct pbuf *l_pbuf;
+  uint32_t     l_left;
+  uint16_t     l_length;
+  uint16_t     l_taken;
+  uint16_t     l_consumed = 0;
+
+  /* Take the queue; more may arrive meanwhile. */
+  cyw43_arch_lwip_begin();
+  l_body = p_request->body;
+  p_request->body = NULL;
+  cyw43_arch_lwip_end();
+
+  /* The consumer takes what it can, but nothing past the body. */
+  for ( l_pbuf = l_body; l_pbuf != NULL; l_pbuf = l_pbuf->next )
+  {
+    if ( p_request->chunked )
+    {
+      l_taken = httpclient_take_chunked( p_request,
+                                         (const char *)l_pbuf->payload,
+                                         l_pbuf->len );
+    }
+    else
+    {
+      l_left = p_request->content_length - p_request->body_length;
+      l_length = ( l_pbuf->len < l_left ) ? l_pbuf->len : l_left;
+      l_taken = httpclient_consume_body( p_request,
+                                         (const char *)l_pbuf->payload,
+                                         l_length );
+      p_request->body_length += l_taken;
+    }
+    l_consumed += l_taken;
+    if ( l_taken < l_pbuf->len )
+    {
+      break;
+    }
+  }
+
+  cyw43_arch_lwip_begin();
+  l_body = pbuf_free_header( l_body, l_consumed );
+  if ( p_request->pcb != NULL )
+  {
+    altcp_recved( p_request->pcb, l_consumed );
+  }
+
+  /*
+   * Once complete, the connection can serve the next request; but not if
+   * the response did not fit, as the rest would be taken for the next one.
+   */
+  if ( p_request->status != HTTPCLIENT_DATA )
+  {
+    /* The consumer or the chunk decoding failed. */
+  }
+  else if ( p_request->chunked ?
+              ( p_request->chunk_state == HTTPCLIENT_CHUNK_DONE ) :
+              ( p_request->body_length == p_request->content_length ) )
+  {
+    p_request->status = HTTPCLIENT_COMPLETE;
+  }
+  else if ( ( p_request->body_callback == NULL ) &&
+            ( p_request->response_length == p_request->response_max_size ) )
+  {
+    p_request->status = HTTPCLIENT_TRUNCATED;
+  }
+  else if ( p_request->body_closed && ( l_body == NULL ) &&
+            ( p_request->body == NULL ) )
+  {
+    /* The server closed early; we have all there is, but a chunked body
+     * says when it is whole, and this one is not. */
+    if ( p_request->chunked )
+    {
+      printf( "Chunked body cut short\n" );
+      p_request->status = HTTPCLIENT_FAILED;
+    }
+    else
+    {
+      p_request->status = HTTPCLIENT_COMPLETE;
+    }
+  }
+
+  if ( p_request->status == HTTPCLIENT_DATA )
+  {
+    /* The rest goes first next time. */
+    if ( l_body != NULL )
+    {
+      if ( p_request->body != NULL )
+      {
+        pbuf_cat( l_body, p_request->body );
+      }
+      p_request->body = l_body;
+    }
+  }
+  else
+  {
+    /* Anything left is not ours; neither is the connection then. */
+    if ( l_body != NULL )
+    {
+      pbuf_free( l_body );
+      p_request->keep_alive = false;
+    }
+    if ( p_request->status == HTTPCLIENT_COMPLETE )
+    {
+      httpclient_idle_connection( p_request );
+    }
+    else
+    {
+      httpclient_close_pcb( p_request );
+    }
+  }
+  cyw43_arch_lwip_end();
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * poll_callback - called after a timeout period within lwIP, to allow us to
+ *                 abort if things are taking too long.
+ */
+
+static err_t httpclient_poll_callback( void *p_request, struct altcp_pcb *p_pcb )
+{
+  httpclient_request_t *l_request = (httpclient_request_t *)p_request;
+  int64_t               l_age_us;
+
+  /* An idle connection is closed before the server would. */
+  if ( l_request == NULL )
+  {
+    l_age_us = absolute_time_diff_us( m_connection.idle_time,
+                                      get_absolute_time() );
+    if ( l_age_us > PCBP_HTTP_IDLE_SECS * 1000000LL )
+    {
+      return httpclient_drop_connection();
+    }
+    return ERR_OK;
+  }
+
+  /*
+   * The pcb polls on its own schedule; give each request its full time,
+   * counted from its release: waiting for that is not the request's doing.
+   * A held request may connect and wait up to PCBP_HTTP_HELD_SECS.
+   */
+  if ( l_request->held )
+  {
+    l_age_us = absolute_time_diff_us( l_request->open_time, get_absolute_time() );
+    if ( l_age_us < PCBP_HTTP_HELD_SECS * 1000000LL )
     {
-      l_truncated = true;
-      l_to_read = l_request->response_max_size - l_request->response_length;
+      return ERR_OK;
     }
-    if ( ( l_request->response_length + l_to_read ) > l_request->content_length )
+  }
+  else
+  {
+    l_age_us = absolute_time_diff_us( l_request->release_time, get_absolute_time() );
+    if ( l_age_us < PCBP_HTTP_TIMEOUT_SECS * 1000000LL )
     {
-      l_truncated = true;
-      l_to_read = l_request->content_length - l_request->response_length;
+      return ERR_OK;
     }
+  }
 
-    /* Phew; now read ... however much we think we want. */
-    l_bytes_read = pbuf_copy_partial( p_buf, l_request->response+l_request->response_length,
-                                      l_to_read, 0 );
-    l_request->response_length += l_bytes_read;
+  /* We *might* have some data, so let's call it 'truncated' - unless the
+   * request was never sent. */
+  l_request->status = ( l_request->status == HTTPCLIENT_READY ) ?
+                        HTTPCLIENT_FAILED : HTTPCLIENT_TRUNCATED;
+  return httpclient_close_pcb( l_request );
+}
 
-    /* Consume that. */
-    altcp_recved( p_pcb, l_bytes_read );
-    p_buf = pbuf_free_header( p_buf, l_bytes_read );
 
-    /*
-     * And lastly, if we reached our limit it's complete, and if we would have
-     * exceed it then we truncated.
-     */
-    if ( ( l_request->response_length == l_request->content_length ) ||
-         ( l_request->response_length == l_request->response_max_size ) )
-    {
-      l_request->status = HTTPCLIENT_COMPLETE;
-    }
-    if ( l_truncated )
+/*
+ * err_callback - called to inform us of any errors within lwIP
+ */
+
+static void httpclient_err_callback( void *p_request, err_t p_error )
+{
+  httpclient_request_t *l_request = (httpclient_request_t *)p_request;
+
+  /* lwIP has freed the pcb already; all we can do is flag it. */
+  printf( "Error callback - %d\n", p_error );
+  httpclient_forget_connection();
+  if ( l_request != NULL )
+  {
+    /* Do not offer a session that the server may have choked on. */
+    if ( l_request->status == HTTPCLIENT_CONNECT )
     {
-      l_request->status = HTTPCLIENT_TRUNCATED;
+      httpclient_forget_session();
     }
+    httpclient_lost_connection( l_request, HTTPCLIENT_FAILED );
   }
 
-  /* All done, return we are happy. */
-  return ERR_OK;
+  /* No return code here. */
+  return;
 }
 
 
 /*
- * poll_callback - called after a timeout period within lwIP, to allow us to
- *                 abort if things are taking too long.
+ * cached_address - gives the request the cached address of its host, if
+ *                  that is younger than the minimum TTL; or, while lookups
+ *                  fail, younger than the maximum. Returns true if so.
  */
 
-static err_t httpclient_poll_callback( void *p_request, struct altcp_pcb *p_pcb )
+static bool httpclient_cached_address( httpclient_request_t *p_request )
 {
-  httpclient_request_t *l_request = (httpclient_request_t *)p_request;
+  absolute_time_t l_now = get_absolute_time();
+  int64_t         l_age_us;
 
-  /* We *might* have some data, so let's call it 'truncated' */
-  l_request->status = HTTPCLIENT_TRUNCATED;
-  return httpclient_close_pcb( l_request );
+  if ( !m_resolver.valid || strcmp( m_resolver.host, p_request->host ) != 0 )
+  {
+    return false;
+  }
+
+  l_age_us = absolute_time_diff_us( m_resolver.good_time, l_now );
+  if ( ( l_age_us < m_dns_min_secs * 1000000LL ) ||
+       ( ( absolute_time_diff_us( l_now, m_resolver.failed_until ) > 0 ) &&
+         ( l_age_us < m_dns_max_secs * 1000000LL ) ) )
+  {
+    memcpy( &p_request->host_addr, &m_resolver.addr, sizeof( ip_addr_t ) );
+    return true;
+  }
+
+  /* Time to ask again. */
+  return false;
 }
 
 
 /*
- * err_callback - called to inform us of any errors within lwIP
+ * dns_failing - true if a lookup of the request's host failed lately, so
+ *               that asking again is not worth it yet.
  */
 
-static void httpclient_err_callback( void *p_request, err_t p_error )
+static bool httpclient_dns_failing( httpclient_request_t *p_request )
 {
-  httpclient_request_t *l_request = (httpclient_request_t *)p_request;
+  return ( strcmp( m_resolver.host, p_request->host ) == 0 ) &&
+         ( absolute_time_diff_us( get_absolute_time(),
+                                  m_resolver.failed_until ) > 0 );
+}
 
-  /* All we can really do is close it and flag it. */
-  printf( "Error callback - %d\n", p_error );
-  l_request->status = HTTPCLIENT_FAILED;
-  httpclient_close_pcb( l_request );
 
-  /* No return code here. */
+/*
+ * dns_found - caches the address of a successful lookup.
+ */
+
+static void httpclient_dns_found( const char *p_host, const ip_addr_t *p_addr )
+{
+  strncpy( m_resolver.host, p_host, PCBP_HTTP_HOST_MAXLEN );
+  m_resolver.host[PCBP_HTTP_HOST_MAXLEN] = '\0';
+  memcpy( &m_resolver.addr, p_addr, sizeof( ip_addr_t ) );
+  m_resolver.valid = true;
+  m_resolver.good_time = get_absolute_time();
+  m_resolver.failed_until = nil_time;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * dns_failed - caches the failure of a lookup for the minimum TTL, and
+ *              connects to the last good address if there is one; else
+ *              the request fails.
+ */
+
+static void httpclient_dns_failed( httpclient_request_t *p_request )
+{
+  /* Any address we had was for another host. */
+  if ( strcmp( m_resolver.host, p_request->host ) != 0 )
+  {
+    strcpy( m_resolver.host, p_request->host );
+    m_resolver.valid = false;
+  }
+  m_resolver.failed_until = make_timeout_time_ms( m_dns_min_secs * 1000 );
+
+  if ( httpclient_cached_address( p_request ) )
+  {
+    printf( "DNS lookup failed, using the last good address %s\n",
+            ipaddr_ntoa( &p_request->host_addr ) );
+    httpclient_connect( p_request, &p_request->host_addr );
+    return;
+  }
+
+  printf( "DNS lookup failed, no address to fall back on\n" );
+  p_request->status = HTTPCLIENT_FAILED;
+  httpclient_close_pcb( p_request );
+
+  /* All done. */
   return;
 }
 
@@ -377,16 +1164,15 @@ void httpclient_dns_callback( const char *p_name,
 {
   httpclient_request_t *l_request = (httpclient_request_t *)p_request;
 
-  /* If the address wasn't found, we abort. */
+  /* If the address wasn't found, fall back or abort. */
   if ( p_address == NULL )
   {
-    printf( "DNS callback did not find address\n" );
-    l_request->status = HTTPCLIENT_FAILED;
-    httpclient_close_pcb( l_request );
+    httpclient_dns_failed( l_request );
     return;
   }
 
   /* Otherwise, save the address and initiate the connection. */
+  httpclient_dns_found( l_request->host, p_address );
   memcpy( &l_request->host_addr, p_address, sizeof( ip_addr_t ) );
   httpclient_connect( l_request, &l_request->host_addr );
 
@@ -398,6 +1184,72 @@ void httpclient_dns_callback( const char *p_name,
 /* Internal functions - used only in this file. */
 
 
+/*
+ * join_wifi - starts joining the WiFi network, unless that is already under
+ *             way (e.g. since httpclient_start_wifi).
+ */
+
+static void httpclient_join_wifi( void )
+{
+  int l_link_status;
+
+  /* Joined but waiting for DHCP counts as under way, too. */
+  l_link_status = cyw43_tcpip_link_status( &cyw43_state, CYW43_ITF_STA );
+  if ( ( l_link_status == CYW43_LINK_JOIN ) ||
+       ( l_link_status == CYW43_LINK_NOIP ) )
+  {
+    return;
+  }
+
+  cyw43_arch_enable_sta_mode();
+  cyw43_arch_wifi_connect_async( m_wifi_ssid, m_wifi_password, CYW43_AUTH_WPA2_AES_PSK );
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * reuse_connection - hands the kept-alive connection to a request for the
+ *                    same server, or else closes it. Returns true if the
+ *                    request got it.
+ */
+
+static bool httpclient_reuse_connection( httpclient_request_t *p_request )
+{
+  /* Nothing to reuse? */
+  if ( m_connection.pcb == NULL )
+  {
+    return false;
+  }
+
+  /* Still busy (then its request is abandoned), or another server. */
+  if ( ( m_connection.request != NULL ) ||
+       ( strcmp( m_connection.host, p_request->host ) != 0 ) ||
+       ( m_connection.port != p_request->port ) ||
+       ( m_connection.tls != p_request->tls ) )
+  {
+    if ( m_connection.request != NULL )
+    {
+      m_connection.request->status = HTTPCLIENT_FAILED;
+    }
+    httpclient_drop_connection();
+    return false;
+  }
+
+  /* Take it over; it is connected already. */
+  p_request->pcb = m_connection.pcb;
+  p_request->reused = true;
+  m_connection.request = p_request;
+  altcp_arg( p_request->pcb, p_request );
+  m_reuses++;
+  httpclient_connect_callback( p_request, p_request->pcb, ERR_OK );
+
+  /* All done. */
+  return true;
+}
+
+
 /*
  * start_request - called when the network is available, in order to intiate
  *                 the communications to the web server.
@@ -406,6 +1258,7 @@ void httpclient_dns_callback( const char *p_name,
 static void httpclient_start_request( httpclient_request_t *p_request )
 {
   err_t               l_retval;
+  bool                l_reused;
 
   /* Sanity check the request. */
   if ( p_request == NULL )
@@ -413,11 +1266,26 @@ static void httpclient_start_request( httpclient_request_t *p_request )
     return;
   }
 
+  /* Keep talking to the server, if we still are. */
+  cyw43_arch_lwip_begin();
+  l_reused = httpclient_reuse_connection( p_request );
+  cyw43_arch_lwip_end();
+  if ( l_reused )
+  {
+    return;
+  }
+
   /* Good; now, allocate a suitable pcb, depending on the request type. */
   if ( p_request->tls )
   {
-    p_request->pcb = altcp_tls_new( altcp_tls_create_config_client( NULL, 0 ), IPADDR_TYPE_V4 );
+    /* The config is never freed: every TLS connection uses it. */
+    if ( m_tls_config == NULL )
+    {
+      m_tls_config = altcp_tls_create_config_client( NULL, 0 );
+    }
+    p_request->pcb = altcp_tls_new( m_tls_config, IPADDR_TYPE_V4 );
     mbedtls_ssl_set_hostname( altcp_tls_context( p_request->pcb ), p_request->host );
+    httpclient_offer_session( p_request );
   }
   else
   {
@@ -430,8 +1298,34 @@ static void httpclient_start_request( httpclient_request_t *p_request )
   altcp_err( p_request->pcb, httpclient_err_callback );
   altcp_poll( p_request->pcb, httpclient_poll_callback, PCBP_HTTP_TIMEOUT_SECS *2 );
 
-  /* Now we lookup the hostname in DNS - lwIP functions need wrapping. */
+  /* Probe while idle, so that a vanished server is noticed before we use it. */
+  altcp_keepalive_enable( p_request->pcb, PCBP_HTTP_KEEPALIVE_IDLE_MS,
+                          PCBP_HTTP_KEEPALIVE_INTVL_MS, PCBP_HTTP_KEEPALIVE_COUNT );
+
+  /* This is the connection to keep, now. */
+  strcpy( m_connection.host, p_request->host );
+  m_connection.port = p_request->port;
+  m_connection.tls = p_request->tls;
+  m_connection.pcb = p_request->pcb;
+  m_connection.request = p_request;
+  m_connects++;
+
+  /* Now we lookup the hostname, in our cache first. */
   p_request->status = HTTPCLIENT_DNS;
+  if ( httpclient_cached_address( p_request ) )
+  {
+    httpclient_connect( p_request, &p_request->host_addr );
+    return;
+  }
+  if ( httpclient_dns_failing( p_request ) )
+  {
+    printf( "DNS lookup failed lately, not asking again yet\n" );
+    p_request->status = HTTPCLIENT_FAILED;
+    httpclient_close_pcb( p_request );
+    return;
+  }
+
+  /* Then in DNS - lwIP functions need wrapping. */
   cyw43_arch_lwip_begin();
   l_retval = dns_gethostbyname( p_request->host, &p_request->host_addr,
                                 httpclient_dns_callback, p_request );
@@ -441,14 +1335,14 @@ static void httpclient_start_request( httpclient_request_t *p_request )
   if ( l_retval == ERR_OK )
   {
     /* Can directly initiate the next step then. */
+    httpclient_dns_found( p_request->host, &p_request->host_addr );
     httpclient_connect( p_request, &p_request->host_addr );
   }
   else if ( l_retval != ERR_INPROGRESS )
   {
-    /* Something failed, so we need to abort the whole connection. */
+    /* Something failed; fall back, or abort the whole connection. */
     printf( "dns_gethostbyname() failed - %d\n", l_retval );
-    p_request->status = HTTPCLIENT_FAILED;
-    httpclient_close_pcb( p_request );
+    httpclient_dns_failed( p_request );
     return;
   }
 
@@ -478,18 +1372,50 @@ void httpclient_set_credentials( const char *p_ssid, const char *p_password )
 
 
 /*
- * open - initiates a new HTTP request; if the WiFi is not available, it will
- *        be brought up with credentials if available.
- *        A new request structure will be allocated, and a pointer to this is
- *        returned. On error, no allocation will be kept and NULL returned.
+ * set_dns_ttl - bounds how long the resolver cache keeps an address: it is
+ *               used without asking for p_min_secs (as is a failed lookup),
+ *               and while lookups fail for up to p_max_secs.
  */
 
-httpclient_request_t *httpclient_open2( const char *p_method,
-                                        const char *p_url,
-                                        char *p_buffer,
-                                        uint16_t p_buffer_size,
-                                        const char *p_extra_headers,
-                                        const char *p_data )
+void httpclient_set_dns_ttl( uint32_t p_min_secs, uint32_t p_max_secs )
+{
+  m_dns_min_secs = p_min_secs;
+  m_dns_max_secs = ( p_max_secs < p_min_secs ) ? p_min_secs : p_max_secs;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * start_wifi - starts joining the WiFi network ahead of the first request,
+ *              so that it happens while the rest of the system starts up.
+ */
+
+void httpclient_start_wifi( void )
+{
+  if ( cyw43_tcpip_link_status( &cyw43_state, CYW43_ITF_STA ) != CYW43_LINK_UP )
+  {
+    httpclient_join_wifi();
+  }
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * open_request - the common part of open and warmup; a held request is not
+ *                sent until released.
+ */
+
+static httpclient_request_t *httpclient_open_request( const char *p_method,
+                                                      const char *p_url,
+                                                      char *p_buffer,
+                                                      uint16_t p_buffer_size,
+                                                      const char *p_extra_headers,
+                                                      const char *p_data,
+                                                      bool p_held )
 {
   uint_fast8_t          l_index;
   const char           *l_charptr;
@@ -510,6 +1436,12 @@ httpclient_request_t *httpclient_open2( const char *p_method,
 
   /* Wipe mem. So we don't return bogus/old status codes for instance. */
   memset( l_request, 0, sizeof(*l_request) );
+  l_request->held = p_held;
+  l_request->open_time = get_absolute_time();
+  if ( !p_held )
+  {
+    l_request->release_time = l_request->open_time;
+  }
 
   /* Work through the URL, work out what we have - scheme first. */
   if ( strncmp( p_url, "http://", 7 ) == 0 )
@@ -593,7 +1525,7 @@ httpclient_request_t *httpclient_open2( const char *p_method,
       // FIXME: add our git version here?
       "User-Agent: " PCBP_REQUEST_USER_AGENT "\r\n"       /* Our user agent */
       "Accept: */*\r\n"                                   /* Accept anything */
-      "Connection: close\r\n"                             /* No persistence */
+      "Connection: keep-alive\r\n"                        /* Persistence */
       "%s%s"
       "\r\n"                                              /* End of headers */
       "%s",                                               /* Optional body */
@@ -633,8 +1565,7 @@ httpclient_request_t *httpclient_open2( const char *p_method,
   else
   {
     /* Network needs to be set up; just kick it off and wait. */
-    cyw43_arch_enable_sta_mode();
-    cyw43_arch_wifi_connect_async( m_wifi_ssid, m_wifi_password, CYW43_AUTH_WPA2_AES_PSK );
+    httpclient_join_wifi();
     l_request->status = HTTPCLIENT_WIFI;
   }
 
@@ -643,6 +1574,72 @@ httpclient_request_t *httpclient_open2( const char *p_method,
 }
 
 
+/*
+ * open - initiates a new HTTP request; if the WiFi is not available, it will
+ *        be brought up with credentials if available.
+ *        A new request structure will be allocated, and a pointer to this is
+ *        returned. On error, no allocation will be kept and NULL returned.
+ */
+
+httpclient_request_t *httpclient_open2( const char *p_method,
+                                        const char *p_url,
+                                        char *p_buffer,
+                                        uint16_t p_buffer_size,
+                                        const char *p_extra_headers,
+                                        const char *p_data )
+{
+  return httpclient_open_request( p_method, p_url, p_buffer, p_buffer_size,
+                                  p_extra_headers, p_data, false );
+}
+
+
+/*
+ * warmup - like open, but only resolves the host and connects (including
+ *          the TLS handshake); the request goes out on httpclient_release,
+ *          so that connection setup need not delay it. The status stays at
+ *          HTTPCLIENT_READY in between.
+ */
+
+httpclient_request_t *httpclient_warmup2( const char *p_method,
+                                          const char *p_url,
+                                          char *p_buffer,
+                                          uint16_t p_buffer_size,
+                                          const char *p_extra_headers,
+                                          const char *p_data )
+{
+  return httpclient_open_request( p_method, p_url, p_buffer, p_buffer_size,
+                                  p_extra_headers, p_data, true );
+}
+
+
+/*
+ * release - sends a warmed up request; now if the connection is ready,
+ *           otherwise as soon as it is.
+ */
+
+void httpclient_release( httpclient_request_t *p_request )
+{
+  /* Sanity check the request. */
+  if ( p_request == NULL || !p_request->held )
+  {
+    return;
+  }
+
+  /* The connect callback must not run halfway through this. */
+  cyw43_arch_lwip_begin();
+  p_request->held = false;
+  p_request->release_time = get_absolute_time();
+  if ( p_request->status == HTTPCLIENT_READY )
+  {
+    httpclient_send_request( p_request );
+  }
+  cyw43_arch_lwip_end();
+
+  /* All done. */
+  return;
+}
+
+
 /*
  *  check - looks to see if any processing is required for a request; usually
  *          work is handled through callbacks, but the WiFi connection is special.
@@ -658,6 +1655,21 @@ httpclient_status_t httpclient_check( httpclient_request_t *p_request )
     return HTTPCLIENT_NONE;
   }
 
+  /* Hand over the body received since the last check. */
+  if ( p_request->status == HTTPCLIENT_DATA )
+  {
+    httpclient_deliver_body( p_request );
+  }
+
+  /* A kept-alive connection went away before the answer: reconnect. */
+  if ( p_request->retry )
+  {
+    printf( "Kept-alive connection lost, reconnecting\n" );
+    p_request->retry = false;
+    p_request->reused = false;
+    httpclient_start_request( p_request );
+  }
+
   /*
    * Most processing is handled through callbacks, but if the WiFi link is
    * still being set up we have to actively monitor that - connecting first.
@@ -701,6 +1713,24 @@ httpclient_status_t httpclient_check( httpclient_request_t *p_request )
 }
 
 
+/*
+ * set_body_callback - streams the body to p_callback instead of collecting
+ *                     it in the response buffer. It is called from
+ *                     httpclient_check, so set it before checking first.
+ */
+
+void httpclient_set_body_callback( httpclient_request_t *p_request,
+                                   httpclient_body_fn p_callback,
+                                   void *p_context )
+{
+  p_request->body_callback = p_callback;
+  p_request->body_context = p_context;
+
+  /* All done. */
+  return;
+}
+
+
 /*
  * get_response - passed a pointer to the response buffer, if the request
  *                has completed - NULL if not.
@@ -727,6 +1757,22 @@ const char *httpclient_get_response( const httpclient_request_t *p_request )
 
 void httpclient_close( httpclient_request_t *p_request )
 {
+  /* Drop the connection if it is still up, e.g. after a timeout; its
+   * callbacks must not see the request again. */
+  cyw43_arch_lwip_begin();
+  httpclient_close_pcb( p_request );
+  if ( p_request->head != NULL )
+  {
+    pbuf_free( p_request->head );
+    p_request->head = NULL;
+  }
+  if ( p_request->body != NULL )
+  {
+    pbuf_free( p_request->body );
+    p_request->body = NULL;
+  }
+  cyw43_arch_lwip_end();
+
   /* If the response has been allocated, free that. */
   if ( p_request->response_allocated && ( p_request->response != NULL ) )
   {
@@ -749,4 +1795,50 @@ void httpclient_close( httpclient_request_t *p_request )
 }
 
 
+/*
+ * disconnect - leave the WiFi network, so that the next request joins it
+ *              afresh; for when connections keep stalling.
+ */
+
+void httpclient_disconnect( void )
+{
+  cyw43_arch_lwip_begin();
+  httpclient_drop_connection();
+  cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
+  cyw43_arch_lwip_end();
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * get_stats - the number of connections made, and of requests that used
+ *             one kept alive since an earlier request instead.
+ */
+
+void httpclient_get_stats( uint32_t *p_connects, uint32_t *p_reuses )
+{
+  *p_connects = m_connects;
+  *p_reuses = m_reuses;
+
+  /* All done. */
+  return;
+}
+
+
+/*
+ * get_tls_stats - the number of full and resumed TLS handshakes, and the
+ *                 time they took (from the TCP connect), in ms.
+ */
+
+void httpclient_get_tls_stats( httpclient_tls_stats_t *p_stats )
+{
+  *p_stats = m_tls_stats;
+
+  /* All done. */
+  return;
+}
+
+
 /* End of file opt/httpclient.c */
@@ -21,8 +21,16 @@
 #define PCBP_HTTP_HOST_MAXLEN       63
 #define PCBP_HTTP_PATH_MAXLEN       127
 #define PCBP_HTTP_TIMEOUT_SECS      10
+#define PCBP_HTTP_HELD_SECS         30
+#define PCBP_HTTP_IDLE_SECS         60
+#define PCBP_HTTP_KEEPALIVE_IDLE_MS 15000
+#define PCBP_HTTP_KEEPALIVE_INTVL_MS 5000
+#define PCBP_HTTP_KEEPALIVE_COUNT   2
+#define PCBP_HTTP_DNS_MIN_SECS      60
+#define PCBP_HTTP_DNS_MAX_SECS      86400
 
 #define PCBP_HEADER_BUFSIZE         1023
+#define PCBP_HEADERS_MAXLEN         8192
 #define PCBP_REQUEST_USER_AGENT     "pim670-zabbix-display"
 
 
@@ -35,6 +43,7 @@ typedef enum
   HTTPCLIENT_WIFI,
   HTTPCLIENT_DNS,
   HTTPCLIENT_CONNECT,
+  HTTPCLIENT_READY,
   HTTPCLIENT_REQUEST,
   HTTPCLIENT_RESPONSE_STATUS,
   HTTPCLIENT_HEADERS,
@@ -44,6 +53,28 @@ typedef enum
   HTTPCLIENT_FAILED
 } httpclient_status_t;
 
+/* Where we are in a "Transfer-Encoding: chunked" body. */
+typedef enum
+{
+  HTTPCLIENT_CHUNK_SIZE_START,
+  HTTPCLIENT_CHUNK_SIZE,
+  HTTPCLIENT_CHUNK_EXTENSION,
+  HTTPCLIENT_CHUNK_DATA,
+  HTTPCLIENT_CHUNK_DATA_END,
+  HTTPCLIENT_CHUNK_TRAILER_START,
+  HTTPCLIENT_CHUNK_TRAILER,
+  HTTPCLIENT_CHUNK_DONE
+} httpclient_chunk_t;
+
+
+/*
+ * Body callback: takes up to p_length bytes of the body and returns how many
+ * it took; what it leaves is offered again on the next httpclient_check.
+ */
+
+typedef uint16_t (*httpclient_body_fn)( void *p_context, const char *p_data,
+                                        uint16_t p_length );
+
 
 /* Structures */
 
@@ -62,18 +93,50 @@ typedef struct
   uint16_t              response_length;
   absolute_time_t       wifi_retry_time;
 
+  /* Warming up: connect now, but hold the request until released. */
+  bool                  held;
+  absolute_time_t       open_time;
+  absolute_time_t       connect_start_time;
+  absolute_time_t       connect_time;
+  absolute_time_t       release_time;
+
+  /* Keep-alive: whether the connection was an earlier request's, whether
+   * the server keeps it after this one, and whether to reconnect. */
+  bool                  reused;
+  bool                  keep_alive;
+  bool                  retry;
+
   /* Managing the HTTP request/response. */
   char*                 send_buffer;
   uint16_t              send_buffer_len;
   char                  header_buffer[PCBP_HEADER_BUFSIZE+1];
+  struct pbuf          *head;
   uint16_t              http_status;
-  uint16_t              content_length;
+  uint32_t              content_length;
+
+  /* The body, as received but not yet handed over. */
+  struct pbuf          *body;
+  uint32_t              body_length;
+  bool                  body_closed;
+  bool                  chunked;
+  httpclient_chunk_t    chunk_state;
+  uint32_t              chunk_left;
+  httpclient_body_fn    body_callback;
+  void                 *body_context;
 
   /* Elements used for low level lwIP conversations. */
   struct altcp_pcb     *pcb;
 
 } httpclient_request_t;
 
+typedef struct
+{
+  uint32_t              full_handshakes;
+  uint32_t              full_handshake_ms;
+  uint32_t              resumed_handshakes;
+  uint32_t              resumed_handshake_ms;
+} httpclient_tls_stats_t;
+
 
 /* Function prototypes. */
 
@@ -82,18 +145,30 @@ extern "C" {
 #endif
 
 void                  httpclient_set_credentials( const char *, const char * );
+void                  httpclient_set_dns_ttl( uint32_t, uint32_t );
+void                  httpclient_start_wifi( void );
 httpclient_request_t *httpclient_open2( const char *p_method, const char *p_url,
                                         char *p_buffer, uint16_t p_buffer_size,
                                         const char *p_extra_headers,
 				        const char *p_data );
+httpclient_request_t *httpclient_warmup2( const char *p_method, const char *p_url,
+                                          char *p_buffer, uint16_t p_buffer_size,
+                                          const char *p_extra_headers,
+                                          const char *p_data );
+void                  httpclient_release( httpclient_request_t * );
 inline httpclient_request_t *httpclient_open( const char *p_url,
                                               char *p_buffer,
                                               uint16_t p_buffer_size) {
     return httpclient_open2( "GET", p_url, p_buffer, p_buffer_size, "", "" );
 }
+void                  httpclient_set_body_callback( httpclient_request_t *,
+                                                    httpclient_body_fn, void * );
 httpclient_status_t   httpclient_check( httpclient_request_t * );
 const char           *httpclient_get_response( const httpclient_request_t * );
 void                  httpclient_close( httpclient_request_t * );
+void                  httpclient_disconnect( void );
+void                  httpclient_get_stats( uint32_t *, uint32_t * );
+void                  httpclient_get_tls_stats( httpclient_tls_stats_t * );
 
 #ifdef __cplusplus
 }
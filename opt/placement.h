@@ -0,0 +1,26 @@
+/*
+ * opt/placement.h - part of PIM670 Zabbix Display
+ *
+ * Code and constants live in flash and run through the 16 KiB XIP cache,
+ * which the hot paths share with lwIP, cyw43 and mbedTLS. HOT_PATH(group)
+ * in front of a function or table definition puts it in SRAM instead, in
+ * section .time_critical.<group>. Give a table a group of its own: a
+ * table and a function cannot share one.
+ *
+ * Only on the device, with PIM670_HOT_IN_RAM set (cmake -DHOT_IN_RAM=OFF
+ * to compare; see the XIP cache hit rates in the stats). Elsewhere, e.g.
+ * in the tests, it does nothing.
+ */
+#ifndef INCLUDED_OPT_PLACEMENT_H
+#define INCLUDED_OPT_PLACEMENT_H
+
+#if PIM670_HOT_IN_RAM
+# include "pico/platform.h"
+# define HOT_PATH(group) __not_in_flash(group)
+#else
+# define HOT_PATH(group)
+#endif
+
+#endif // INCLUDED_OPT_PLACEMENT_H
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
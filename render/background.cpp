@@ -0,0 +1,145 @@
+/*
+ * render/background.cpp - part of PIM670 Zabbix Display
+ */
+
+#include <cstdlib>
+
+#include "opt/placement.h"
+#include "render/background.hpp"
+
+#ifdef RUNTESTS
+# include <cstring>
+
+# include "render/bench.hpp"
+#endif
+
+namespace render {
+
+HOT_PATH("render") uint8_t Background::new_lifetime()
+{
+    return LIFETIME_MIN + (rand() % LIFETIME_SPREAD);
+}
+
+void Background::init()
+{
+    for (int i = 0; i < CELLS; ++i)
+    {
+        m_lifetime[i] = new_lifetime();
+        m_age[i] = (rand() % 100) * m_lifetime[i] / 100;
+    }
+}
+
+} // namespace render
+
+#ifdef RUNTESTS
+using namespace render;
+
+/* The float version as it was in main.cpp, for the golden frames. */
+static float lifetime[32][32];
+static float age[32][32];
+
+static void float_init(unsigned seed)
+{
+    srand(seed);
+    for (int y = 0; y < 32; ++y)
+    {
+        for (int x = 0; x < 32; ++x)
+        {
+            lifetime[x][y] = 1.0f + ((rand() % 10) / 100.0f);
+            /* Age on a tick, as it is after the first lifetime reset. */
+            int ticks = rand() % 100;
+            age[x][y] = 0.0f;
+            for (int i = 0; i < ticks; ++i)
+            {
+                age[x][y] += 0.01f;
+            }
+        }
+    }
+}
+
+static void float_update(uint32_t* frame, const palette::BackgroundPens& pens)
+{
+    for (int y = 0; y < 32; ++y)
+    {
+        for (int x = 0; x < 32; ++x)
+        {
+            if (age[x][y] < lifetime[x][y] * 0.3f)
+            {
+                frame[y * 32 + x] = pens[palette::DECAY_UNIT];
+            }
+            else if (age[x][y] < lifetime[x][y] * 0.5f)
+            {
+                float decay = (lifetime[x][y] * 0.5f - age[x][y]) * 5.0f;
+                frame[y * 32 + x] = pens[palette::decay_level(decay)];
+            }
+            if (age[x][y] >= lifetime[x][y])
+            {
+                age[x][y] = 0.0f;
+                lifetime[x][y] = 1.0f + ((rand() % 10) / 100.0f);
+            }
+            age[x][y] += 0.01f;
+        }
+    }
+}
+
+int main()
+{
+    const palette::BackgroundPens& pens = palette::background[palette::FRESH];
+    static uint32_t golden[32 * 32];
+    static uint32_t frame[32 * 32];
+    constexpr unsigned seed = 670;
+    constexpr int golden_frames = 2000;
+    int bad_frames = 0;
+
+    float_init(seed);
+    Background bg;
+    bench::FrameSink sink = {frame, pens.data()};
+    srand(seed);
+    for (int i = 0; i < Background::CELLS; ++i)
+    {
+        int lifetime = Background::LIFETIME_MIN
+                       + (rand() % Background::LIFETIME_SPREAD);
+        bg.set_cell(i, rand() % 100, lifetime);
+    }
+    for (int n = 0; n < golden_frames; ++n)
+    {
+        /* The float loop redraws everything; we only draw changes. */
+        memset(golden, 0, sizeof(golden));
+        /* Both consume rand() in the same order, if all goes well. */
+        unsigned state = rand();
+        srand(state);
+        float_update(golden, pens);
+        srand(state);
+        bg.update(sink);
+        if (memcmp(golden, frame, sizeof(frame)) != 0)
+        {
+            if (!bad_frames)
+            {
+                printf("background: frame %d differs from golden\n", n);
+            }
+            ++bad_frames;
+        }
+    }
+    printf(
+        "background: %d/%d frames differ from float golden frames\n",
+        bad_frames, golden_frames);
+
+    constexpr int frames = 20000;
+    float_init(seed);
+    bench::Result before = bench::measure(frames, [&]() {
+        float_update(frame, pens);
+        bench::keep(frame);
+    });
+    bg.init();
+    bench::Result after = bench::measure(frames, [&]() {
+        bg.update(sink);
+        bench::keep(frame);
+    });
+    printf("background: frame update (32x32), average of %d:\n", frames);
+    bench::report("float [x][y] age/lifetime", before);
+    bench::report("uint8_t row-major ticks", after);
+    return bad_frames ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,114 @@
+/*
+ * render/background.hpp - part of PIM670 Zabbix Display
+ *
+ * The "eighties super computer" background: every pixel blinks on, fades
+ * out, stays off for a bit and starts over, each with its own lifetime.
+ *
+ * All state is kept in integer frame ticks (1 tick = 10 ms), as a structure
+ * of arrays in row-major order, so a frame update is a linear walk over two
+ * small byte arrays without any (soft-)float math.
+ */
+#ifndef INCLUDED_RENDER_BACKGROUND_HPP
+#define INCLUDED_RENDER_BACKGROUND_HPP
+
+#include <cstdint>
+
+#include "render/palette.hpp"
+
+namespace render {
+
+class Background
+{
+public:
+    static constexpr int WIDTH = 32;
+    static constexpr int HEIGHT = 32;
+    static constexpr int CELLS = WIDTH * HEIGHT;
+
+    /* Lifetimes are 1.00 .. 1.09 s. */
+    static constexpr int LIFETIME_MIN = 100;
+    static constexpr int LIFETIME_SPREAD = 10;
+
+    /* Randomize all cells. Uses rand(), like the rest of the code. */
+    void init();
+
+    /* Random lifetime for a new cycle, in ticks. */
+    static uint8_t new_lifetime();
+
+    /* Set a single cell (row-major index), in ticks. */
+    void set_cell(int index, int age, int lifetime)
+    {
+        m_age[index] = age;
+        m_lifetime[index] = lifetime;
+    }
+
+    /* Palette level (0 = off) for a cell at age/lifetime. The comparisons
+     * match what the original float code did: its accumulated 0.01f ages
+     * end up just below the exact tick, so "<" behaved as "<=". */
+    static int level(int age, int lifetime)
+    {
+        if (age * 10 <= lifetime * 3)
+        {
+            return palette::DECAY_UNIT;
+        }
+        if (age * 2 < lifetime)
+        {
+            /* decay = (lifetime/2 - age) * 5 / 100 = level / 40 */
+            return lifetime - 2 * age;
+        }
+        return 0;
+    }
+
+    /* Make the next update() report every cell, not just the changes. */
+    void invalidate()
+    {
+        m_invalid = true;
+    }
+
+    /* Advance one frame. Calls sink.plot(x, y, level) in row-major order
+     * for every cell whose level differs from what it reported the previous
+     * frame (level 0 being off), with the level before advancing. Without
+     * advance, only reports: after invalidate(), a repaint that stands
+     * still. */
+    template <typename Sink>
+    void update(Sink& sink, bool advance = true)
+    {
+        int i = 0;
+        for (int y = 0; y < HEIGHT; ++y)
+        {
+            for (int x = 0; x < WIDTH; ++x, ++i)
+            {
+                int age = m_age[i];
+                int lifetime = m_lifetime[i];
+                int lvl = level(age, lifetime);
+                /* Age 1 follows a reset; the cell was off before that. */
+                int prev = (age > 1) ? level(age - 1, lifetime) : 0;
+                if (lvl != prev || m_invalid)
+                {
+                    sink.plot(x, y, lvl);
+                }
+                if (!advance)
+                {
+                    continue;
+                }
+                if (age > lifetime)
+                {
+                    age = 0;
+                    m_lifetime[i] = new_lifetime();
+                }
+                m_age[i] = age + 1;
+            }
+        }
+        m_invalid = false;
+    }
+
+private:
+    uint8_t m_age[CELLS];
+    uint8_t m_lifetime[CELLS];
+    bool m_invalid = true;
+};
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_BACKGROUND_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,100 @@
+/*
+ * render/bench.hpp - part of PIM670 Zabbix Display
+ *
+ * Host-side timing helpers for the RUNTESTS benchmarks in render/.
+ */
+#ifndef INCLUDED_RENDER_BENCH_HPP
+#define INCLUDED_RENDER_BENCH_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+namespace render {
+namespace bench {
+
+/* Keep the optimizer from dropping the work we measure. */
+template <typename T>
+inline void keep(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+inline uint64_t nanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/* TSC cycles on x86, nanoseconds elsewhere. */
+inline uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return nanos();
+#endif
+}
+
+struct Result
+{
+    uint64_t cycles;
+    uint64_t nanos;
+};
+
+/* Run fn() iterations times; return the average cost per iteration. */
+template <typename F>
+Result measure(int iterations, F fn)
+{
+    uint64_t c0 = cycles();
+    uint64_t n0 = nanos();
+    for (int i = 0; i < iterations; ++i)
+    {
+        fn();
+    }
+    uint64_t c1 = cycles();
+    uint64_t n1 = nanos();
+    return Result{(c1 - c0) / iterations, (n1 - n0) / iterations};
+}
+
+/* Background engine sink that draws on a plain 32x32 frame. */
+struct FrameSink
+{
+    uint32_t* frame;
+    const uint32_t* pens;
+
+    void plot(int x, int y, int level)
+    {
+        frame[y * 32 + x] = pens[level];
+    }
+    void fill(int y, uint32_t mask, int level)
+    {
+        for (int x = 0; mask; ++x, mask >>= 1)
+        {
+            if (mask & 1)
+            {
+                frame[y * 32 + x] = pens[level];
+            }
+        }
+    }
+};
+
+inline void report(const char* what, const Result& res)
+{
+    printf(
+        "  %-36s %8llu cycles %8llu ns\n", what,
+        static_cast<unsigned long long>(res.cycles),
+        static_cast<unsigned long long>(res.nanos));
+}
+
+} // namespace bench
+} // namespace render
+
+#endif // INCLUDED_RENDER_BENCH_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,161 @@
+/*
+ * render/bitboard.cpp - part of PIM670 Zabbix Display
+ */
+
+#include <cstdlib>
+
+#include "opt/placement.h"
+#include "render/bitboard.hpp"
+
+#ifdef RUNTESTS
+# include <cstring>
+
+# include "render/bench.hpp"
+#endif
+
+namespace render {
+
+void BitboardBackground::init()
+{
+    for (int i = 0; i < CELLS; ++i)
+    {
+        int lifetime = Background::new_lifetime();
+        set_cell(i, (rand() % 100) * lifetime / 100, lifetime);
+    }
+}
+
+void BitboardBackground::set_cell(int index, int age, int lifetime)
+{
+    int y = index / WIDTH;
+    int x = index % WIDTH;
+    uint32_t bit = 1u << x;
+
+    m_lifetime[index] = lifetime;
+    m_odd[y] = (m_odd[y] & ~bit) | ((lifetime & 1) ? bit : 0);
+    m_on[y] &= ~bit;
+    m_fade[y] &= ~bit;
+
+    /* Same phases as Background::level(); ages run 1 .. lifetime + 1. */
+    if (age <= on_ticks(lifetime))
+    {
+        m_on[y] |= bit;
+        set_count(y, x, on_ticks(lifetime) - age + 1);
+    }
+    else if (age <= fade_end(lifetime))
+    {
+        m_fade[y] |= bit;
+        set_count(y, x, fade_end(lifetime) - age + 1);
+    }
+    else
+    {
+        set_count(y, x, lifetime + 2 - age);
+    }
+}
+
+HOT_PATH("render") void BitboardBackground::set_count(
+    int y, int x, int value)
+{
+    uint32_t bit = 1u << x;
+    for (int k = 0; k < COUNTER_BITS; ++k)
+    {
+        m_count[y][k] = (m_count[y][k] & ~bit) | (((value >> k) & 1) << x);
+    }
+}
+
+HOT_PATH("render") void BitboardBackground::next_phase(int y, int x)
+{
+    uint32_t bit = 1u << x;
+    int index = y * WIDTH + x;
+    int lifetime = m_lifetime[index];
+
+    if (m_on[y] & bit)
+    {
+        /* On -> fading. */
+        m_on[y] &= ~bit;
+        m_fade[y] |= bit;
+        set_count(y, x, fade_end(lifetime) - on_ticks(lifetime));
+    }
+    else if (m_fade[y] & bit)
+    {
+        /* Fading -> off. */
+        m_fade[y] &= ~bit;
+        set_count(y, x, lifetime + 1 - fade_end(lifetime));
+    }
+    else
+    {
+        /* Off -> on, with a new lifetime. */
+        lifetime = Background::new_lifetime();
+        m_lifetime[index] = lifetime;
+        m_odd[y] = (m_odd[y] & ~bit) | ((lifetime & 1) ? bit : 0);
+        m_on[y] |= bit;
+        set_count(y, x, on_ticks(lifetime));
+    }
+}
+
+} // namespace render
+
+#ifdef RUNTESTS
+using namespace render;
+
+int main()
+{
+    const palette::BackgroundPens& pens = palette::background[palette::FRESH];
+    static uint32_t expected[32 * 32];
+    static uint32_t frame[32 * 32];
+    static Background pixel;
+    static BitboardBackground bitboard;
+    constexpr unsigned seed = 670;
+    constexpr int compare_frames = 5000;
+    int bad_frames = 0;
+    bench::FrameSink expected_sink = {expected, pens.data()};
+    bench::FrameSink sink = {frame, pens.data()};
+
+    srand(seed);
+    pixel.init();
+    srand(seed);
+    bitboard.init();
+    for (int n = 0; n < compare_frames; ++n)
+    {
+        unsigned state = rand();
+        srand(state);
+        pixel.update(expected_sink);
+        srand(state);
+        bitboard.update(sink);
+        if (n % 7 == 3)
+        {
+            /* A repaint that stands still, as for a frozen background. */
+            pixel.invalidate();
+            pixel.update(expected_sink, false);
+            bitboard.invalidate();
+            bitboard.update(sink, false);
+        }
+        if (memcmp(expected, frame, sizeof(frame)) != 0)
+        {
+            if (!bad_frames)
+            {
+                printf("bitboard: frame %d differs from per-pixel\n", n);
+            }
+            ++bad_frames;
+        }
+    }
+    printf(
+        "bitboard: %d/%d frames differ from per-pixel engine\n", bad_frames,
+        compare_frames);
+
+    constexpr int frames = 20000;
+    bench::Result before = bench::measure(frames, [&]() {
+        pixel.update(sink);
+        bench::keep(frame);
+    });
+    bench::Result after = bench::measure(frames, [&]() {
+        bitboard.update(sink);
+        bench::keep(frame);
+    });
+    printf("bitboard: frame update (32x32), average of %d:\n", frames);
+    bench::report("per-pixel (render::Background)", before);
+    bench::report("bitboard (render::BitboardBackground)", after);
+    return bad_frames ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
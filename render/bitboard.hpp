@@ -0,0 +1,155 @@
+/*
+ * render/bitboard.hpp - part of PIM670 Zabbix Display
+ *
+ * Bit-parallel (SWAR) version of render::Background. The display is 32
+ * pixels wide, so every row fits in a uint32_t:
+ *
+ * - m_on/m_fade hold the phase of each cell as row bitmasks (off is the
+ *   rest);
+ * - m_count holds, bit-sliced, the ticks left in the current phase; a
+ *   whole row counts down with a handful of word-wide operations;
+ * - only cells whose counter runs out are touched one by one.
+ *
+ * Given the same rand() sequence, it produces the exact same frames as
+ * render::Background.
+ */
+#ifndef INCLUDED_RENDER_BITBOARD_HPP
+#define INCLUDED_RENDER_BITBOARD_HPP
+
+#include <cstdint>
+
+#include "render/background.hpp"
+#include "render/palette.hpp"
+
+namespace render {
+
+class BitboardBackground
+{
+public:
+    static constexpr int WIDTH = Background::WIDTH;
+    static constexpr int HEIGHT = Background::HEIGHT;
+    static constexpr int CELLS = Background::CELLS;
+
+    /* Longest phase is off: lifetime + 2 - (lifetime - 1) / 2 <= 56. */
+    static constexpr int COUNTER_BITS = 6;
+
+    /* Randomize all cells; uses rand() like Background::init(). */
+    void init();
+
+    /* Set a single cell (row-major index) from a Background age/lifetime. */
+    void set_cell(int index, int age, int lifetime);
+
+    /* Make the next update() report every cell, not just the changes. */
+    void invalidate()
+    {
+        m_invalid = true;
+    }
+
+    /* Advance one frame. Reports every cell whose level differs from what
+     * it reported the previous frame (level 0 being off), row by row, with
+     * the level it had before advancing: whole row masks of cells with the
+     * same level through sink.fill(y, mask, level), and single cells
+     * through sink.plot(x, y, level). Without advance, only reports, like
+     * Background::update(). */
+    template <typename Sink>
+    void update(Sink& sink, bool advance = true)
+    {
+        for (int y = 0; y < HEIGHT; ++y)
+        {
+            uint32_t* count = m_count[y];
+            uint32_t on = m_on[y];
+            uint32_t fade = m_fade[y];
+
+            /* Which cells to report: new on-cells (their level is fixed),
+             * all fading cells (their level drops every tick) and the cells
+             * that went dark. */
+            uint32_t new_on = on & ~m_shown_on[y];
+            uint32_t gone = m_shown_lit[y] & ~(on | fade);
+            if (m_invalid)
+            {
+                new_on = on;
+                gone = ~(on | fade);
+            }
+            m_shown_on[y] = on;
+            m_shown_lit[y] = on | fade;
+
+            if (new_on)
+            {
+                sink.fill(y, new_on, palette::DECAY_UNIT);
+            }
+            for (; fade; fade &= fade - 1)
+            {
+                /* Fade level is lifetime - 2 * age, which works out to
+                 * 2 * ticks_left, minus one for odd lifetimes. */
+                int x = __builtin_ctz(fade);
+                int left = get_count(count, x);
+                sink.plot(x, y, 2 * left - ((m_odd[y] >> x) & 1));
+            }
+            if (gone)
+            {
+                sink.fill(y, gone, 0);
+            }
+            if (!advance)
+            {
+                continue;
+            }
+
+            /* Count down all 32 cells at once. */
+            uint32_t borrow = ~0u;
+            uint32_t nonzero = 0;
+            for (int k = 0; k < COUNTER_BITS; ++k)
+            {
+                uint32_t plane = count[k];
+                count[k] = plane ^ borrow;
+                borrow &= ~plane;
+                nonzero |= count[k];
+            }
+
+            /* Move cells that ran out to their next phase. */
+            for (uint32_t expired = ~nonzero; expired; expired &= expired - 1)
+            {
+                next_phase(y, __builtin_ctz(expired));
+            }
+        }
+        m_invalid = false;
+    }
+
+private:
+    static int on_ticks(int lifetime)
+    {
+        return lifetime * 3 / 10;
+    }
+    static int fade_end(int lifetime)
+    {
+        return (lifetime - 1) / 2;
+    }
+
+    int get_count(const uint32_t* count, int x) const
+    {
+        int value = 0;
+        for (int k = 0; k < COUNTER_BITS; ++k)
+        {
+            value |= ((count[k] >> x) & 1) << k;
+        }
+        return value;
+    }
+    void set_count(int y, int x, int value);
+    void next_phase(int y, int x);
+
+    uint32_t m_on[HEIGHT];
+    uint32_t m_fade[HEIGHT];
+    uint32_t m_odd[HEIGHT];
+    uint32_t m_count[HEIGHT][COUNTER_BITS];
+    /* Only read when a cell changes phase. */
+    uint8_t m_lifetime[CELLS];
+    /* What update() reported last time. */
+    uint32_t m_shown_on[HEIGHT];
+    uint32_t m_shown_lit[HEIGHT];
+    bool m_invalid = true;
+};
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_BITBOARD_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
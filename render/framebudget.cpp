@@ -0,0 +1,114 @@
+/*
+ * render/framebudget.cpp - part of PIM670 Zabbix Display
+ */
+
+#include "render/framebudget.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+#endif
+
+namespace render {
+
+Quality FrameBudget::add_frame(uint32_t frame_us)
+{
+    bump(m_frames);
+    Quality quality = m_quality;
+    if (frame_us > m_budget_us)
+    {
+        bump(m_overruns);
+        m_fit = 0;
+        if (++m_over >= DEGRADE_AFTER && quality < Q_FROZEN)
+        {
+            quality = static_cast<Quality>(quality + 1);
+            bump(m_degraded);
+            m_over = 0;
+        }
+    }
+    else
+    {
+        m_over = 0;
+        if (++m_fit >= RECOVER_AFTER && quality > Q_FULL)
+        {
+            quality = static_cast<Quality>(quality - 1);
+            m_fit = 0;
+        }
+    }
+    m_quality = quality;
+    return quality;
+}
+
+} // namespace render
+
+#ifdef RUNTESTS
+using namespace render;
+
+int main()
+{
+    int errors = 0;
+    FrameBudget budget;
+    budget.set_budget_us(8000);
+
+    /* A single slow frame now and then changes nothing. */
+    for (int i = 0; i < 1000; ++i)
+    {
+        budget.add_frame((i % FrameBudget::DEGRADE_AFTER) ? 3000 : 9000);
+    }
+    if (budget.quality() != Q_FULL)
+    {
+        printf("framebudget: degraded by the odd slow frame\n");
+        ++errors;
+    }
+
+    /* Slow frames in a row degrade one step at a time, down to frozen. */
+    for (int want = Q_HALF_RATE; want <= Q_FROZEN + 1; ++want)
+    {
+        Quality quality = Q_FULL;
+        for (int i = 0; i < FrameBudget::DEGRADE_AFTER; ++i)
+        {
+            quality = budget.add_frame(20000);
+        }
+        int expect = (want > Q_FROZEN) ? Q_FROZEN : want;
+        if (quality != expect)
+        {
+            printf("framebudget: quality %d, want %d\n", quality, expect);
+            ++errors;
+        }
+    }
+    if (budget.degraded() != 3 || budget.overruns() != 334 + 12)
+    {
+        printf(
+            "framebudget: %u degrades, %u overruns; want 3, 346\n",
+            budget.degraded(), budget.overruns());
+        ++errors;
+    }
+
+    /* Frames that fit bring it back, a step at a time. */
+    int steps = 0;
+    Quality last = budget.quality();
+    for (int i = 0; i < 4 * FrameBudget::RECOVER_AFTER; ++i)
+    {
+        Quality quality = budget.add_frame(1000);
+        if (quality != last)
+        {
+            if (quality != last - 1 || (i + 1) % FrameBudget::RECOVER_AFTER)
+            {
+                printf("framebudget: recovers to %d at %d\n", quality, i);
+                ++errors;
+            }
+            ++steps;
+            last = quality;
+        }
+    }
+    if (steps != 3 || last != Q_FULL)
+    {
+        printf("framebudget: %d recovery steps, want 3\n", steps);
+        ++errors;
+    }
+
+    printf("framebudget: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,92 @@
+/*
+ * render/framebudget.hpp - part of PIM670 Zabbix Display
+ *
+ * Watches how long frames take and trades quality for frame rate when
+ * they keep overrunning the budget, e.g. while core0 erases flash (which
+ * stalls core1) or runs a TLS handshake. Quality drops a step after a few
+ * overruns in a row and comes back a step at a time once frames fit
+ * again for a while. The alert blocks are drawn at every quality.
+ */
+#ifndef INCLUDED_RENDER_FRAMEBUDGET_HPP
+#define INCLUDED_RENDER_FRAMEBUDGET_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace render {
+
+typedef enum Qualities
+{
+    Q_FULL = 0,
+    /* The background moves at half the frame rate. */
+    Q_HALF_RATE,
+    /* Also, alert changes show at once instead of animating. */
+    Q_NO_TRANSITIONS,
+    /* Also, the background stands still. */
+    Q_FROZEN
+} Quality;
+
+class FrameBudget
+{
+public:
+    /* Drop a step after this many overruns in a row... */
+    static constexpr int DEGRADE_AFTER = 3;
+    /* ... and go back up a step after this many frames in budget. */
+    static constexpr int RECOVER_AFTER = 100;
+
+    void set_budget_us(uint32_t budget_us)
+    {
+        m_budget_us = budget_us;
+    }
+    uint32_t budget_us() const
+    {
+        return m_budget_us;
+    }
+
+    /* A frame took frame_us, from when it should have started until it
+     * was on display. Returns the quality for the next one. */
+    Quality add_frame(uint32_t frame_us);
+
+    Quality quality() const
+    {
+        return m_quality;
+    }
+
+    /* Counters; safe to read from the other core. */
+    uint32_t frames() const
+    {
+        return m_frames.load(std::memory_order_relaxed);
+    }
+    uint32_t overruns() const
+    {
+        return m_overruns.load(std::memory_order_relaxed);
+    }
+    uint32_t degraded() const
+    {
+        return m_degraded.load(std::memory_order_relaxed);
+    }
+
+private:
+    /* Single writer: no read-modify-write needed (nor available on the
+     * Cortex-M0+). */
+    static void bump(std::atomic<uint32_t>& counter)
+    {
+        counter.store(
+            counter.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+    }
+
+    uint32_t m_budget_us = 8000;
+    std::atomic<Quality> m_quality{Q_FULL};
+    int m_over = 0;
+    int m_fit = 0;
+    std::atomic<uint32_t> m_frames{0};
+    std::atomic<uint32_t> m_overruns{0};
+    std::atomic<uint32_t> m_degraded{0};
+};
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_FRAMEBUDGET_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
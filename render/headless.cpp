@@ -0,0 +1,525 @@
+/*
+ * render/headless.cpp - part of PIM670 Zabbix Display
+ *
+ * Runs the renderer on the host, against a fake Cosmic Unicorn: renders
+ * fixed alert sets, compares the frames to the golden images in
+ * render/golden/ (PPM) and reports the cost of each render stage. The P8
+ * renderer must produce the same images once resolved.
+ *
+ *   ./headless_test           compare; write mismatching frames to ./
+ *   ./headless_test --update  (re)write the golden images
+ */
+
+#ifdef RUNTESTS
+# include <cstdio>
+# include <cstdlib>
+# include <cstring>
+# include <string>
+# include <vector>
+
+# include "render/bench.hpp"
+# include "render/renderer.hpp"
+#endif
+
+#ifdef RUNTESTS
+using namespace render;
+
+/* What CosmicUnicorn::update() does with a PicoGraphics_PenRGB888 frame:
+ * scale by brightness and gamma correct every channel. The real one then
+ * builds the PIO bitstream. */
+class FakeUnicorn
+{
+public:
+    static constexpr int WIDTH = 32;
+    static constexpr int HEIGHT = 32;
+
+    FakeUnicorn()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            float v = i / 255.0f;
+            m_gamma[i] = static_cast<uint16_t>(v * v * 65535.0f);
+        }
+    }
+
+    void update(const uint32_t* frame)
+    {
+        for (int i = 0; i < WIDTH * HEIGHT; ++i)
+        {
+            uint32_t rgb = frame[i];
+            m_panel[i][0] = m_gamma[((rgb >> 16) & 0xff) * m_brightness >> 8];
+            m_panel[i][1] = m_gamma[((rgb >> 8) & 0xff) * m_brightness >> 8];
+            m_panel[i][2] = m_gamma[(rgb & 0xff) * m_brightness >> 8];
+        }
+    }
+
+private:
+    uint16_t m_gamma[256];
+    uint16_t m_panel[WIDTH * HEIGHT][3];
+    int m_brightness = 128;
+};
+
+/* What PicoGraphics_PenP8 keeps: the palette the frame indexes into. */
+static uint32_t fake_palette[256];
+static void fake_set_palette(int index, uint32_t rgb)
+{
+    fake_palette[index] = rgb;
+}
+
+/* Deterministic time: every frame is exactly 10 ms. */
+static uint32_t fake_now_us;
+static uint32_t fake_clock_us()
+{
+    return fake_now_us;
+}
+
+static std::vector<uint8_t> to_ppm(const uint32_t* frame)
+{
+    char header[32];
+    int len = snprintf(header, sizeof(header), "P6\n32 32\n255\n");
+    std::vector<uint8_t> ppm(header, header + len);
+    for (int i = 0; i < 32 * 32; ++i)
+    {
+        ppm.push_back((frame[i] >> 16) & 0xff);
+        ppm.push_back((frame[i] >> 8) & 0xff);
+        ppm.push_back(frame[i] & 0xff);
+    }
+    return ppm;
+}
+
+static bool read_file(const std::string& path, std::vector<uint8_t>& data)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t len;
+    data.clear();
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        data.insert(data.end(), buf, buf + len);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool write_file(
+    const std::string& path, const std::vector<uint8_t>& data)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return (fclose(fp) == 0) && ok;
+}
+
+/* Alerts 1..count; every 7th one suppressed. */
+static std::vector<Block> make_blocks(int count)
+{
+    std::vector<Block> blocks;
+    for (int i = 1; i <= count; ++i)
+    {
+        blocks.push_back(Block{static_cast<uint32_t>(i), i % 7 == 0});
+    }
+    return blocks;
+}
+
+/* Boot, show count alerts and let the transition and the background run
+ * for a second. Returns the RGB888 frame. */
+static void render_scene(
+    uint32_t* frame, int count, bool recent, FrameFormat format)
+{
+    static uint8_t indexed[32 * 32];
+    RendererRGB888 rgb888(frame, fake_clock_us);
+    RendererP8 p8(indexed, fake_clock_us, fake_set_palette);
+    Renderer& renderer = (format == FRAME_P8)
+                             ? static_cast<Renderer&>(p8)
+                             : static_cast<Renderer&>(rgb888);
+    FakeUnicorn unicorn;
+    srand(670);
+    fake_now_us = 0;
+    memset(frame, 0, 32 * 32 * sizeof(uint32_t));
+    memset(indexed, 0, sizeof(indexed));
+    renderer.init();
+    for (int n = 0; n < 100; ++n)
+    {
+        if (n == 1)
+        {
+            renderer.set_blocks(make_blocks(count));
+        }
+        if (renderer.render(recent))
+        {
+            if (format == FRAME_P8)
+            {
+                /* What frame_convert() does for the display. */
+                for (int i = 0; i < 32 * 32; ++i)
+                {
+                    frame[i] = fake_palette[indexed[i]];
+                }
+            }
+            unicorn.update(frame);
+        }
+        fake_now_us += 10000;
+    }
+}
+
+static int check_golden(bool update)
+{
+    static uint32_t frame[32 * 32];
+    int errors = 0;
+    for (int count : {0, 1, 9, 100, 225})
+    {
+        for (int recent = 0; recent < 2; ++recent)
+        {
+            char name[32];
+            snprintf(
+                name, sizeof(name), "%03d-%s.ppm", count,
+                recent ? "fresh" : "stale");
+            render_scene(frame, count, recent, FRAME_RGB888);
+            std::vector<uint8_t> ppm = to_ppm(frame);
+            std::string golden = std::string("golden/") + name;
+            std::vector<uint8_t> want;
+            if (update)
+            {
+                if (!write_file(golden, ppm))
+                {
+                    printf("headless: cannot write %s\n", golden.c_str());
+                    ++errors;
+                }
+            }
+            else if (!read_file(golden, want) || want != ppm)
+            {
+                write_file(name, ppm);
+                printf(
+                    "headless: %s differs from golden (see ./%s)\n",
+                    golden.c_str(), name);
+                ++errors;
+            }
+            render_scene(frame, count, recent, FRAME_P8);
+            if (!update && to_ppm(frame) != ppm)
+            {
+                printf("headless: P8 %s differs from RGB888\n", name);
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
+
+/* Whether any of the layouts puts a block on pixel x, y. */
+static bool covered(std::initializer_list<int> counts, int x, int y)
+{
+    for (int count : counts)
+    {
+        Layout layout;
+        layout.set_count(count);
+        for (int i = 0; i < layout.count(); ++i)
+        {
+            const BlockRect& r = layout[i];
+            if (x >= r.x && x < r.x + r.w && y >= r.y && y < r.y + r.h)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* The background pixels of both frames differ, outside all layouts. */
+static bool background_differs(
+    const uint32_t* a, const uint32_t* b, std::initializer_list<int> counts)
+{
+    for (int y = 0; y < 32; ++y)
+    {
+        for (int x = 0; x < 32; ++x)
+        {
+            if (a[y * 32 + x] != b[y * 32 + x] && !covered(counts, x, y))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Frozen, the background stands still, but alert changes show at once;
+ * back at full quality, it moves again. */
+static int check_degraded()
+{
+    static uint32_t frame[32 * 32];
+    int errors = 0;
+    RendererRGB888 renderer(frame, fake_clock_us);
+    srand(670);
+    fake_now_us = 0;
+    renderer.init();
+    renderer.set_quality(Q_FROZEN);
+    renderer.render(true);
+    renderer.set_blocks(make_blocks(9));
+    renderer.render(true);
+    fake_now_us += 10000;
+    if (renderer.render(true))
+    {
+        printf("headless: frozen background still moves\n");
+        ++errors;
+    }
+
+    static uint32_t before[32 * 32];
+    memcpy(before, frame, sizeof(before));
+    renderer.set_blocks(make_blocks(10));
+    bool changed = renderer.render(true);
+    if (background_differs(before, frame, {9, 10}))
+    {
+        printf("headless: frozen background moves with the blocks\n");
+        ++errors;
+    }
+    Layout layout;
+    layout.set_count(10);
+    const BlockRect& last = layout[9];
+    if (renderer.transitioning() || !changed
+        || frame[last.y * 32 + last.x] != palette::alert[palette::FRESH][0])
+    {
+        printf("headless: frozen, a new alert does not show at once\n");
+        ++errors;
+    }
+
+    renderer.set_quality(Q_FULL);
+    changed = false;
+    for (int n = 0; n < 100 && !changed; ++n)
+    {
+        fake_now_us += 10000;
+        changed = renderer.render(true);
+    }
+    if (!changed)
+    {
+        printf("headless: background does not move after recovering\n");
+        ++errors;
+    }
+    return errors;
+}
+
+/* At half rate, the background moves every other frame, also while a
+ * transition repaints it every frame. */
+static int check_half_rate()
+{
+    static uint32_t still[32 * 32];
+    static uint32_t moving[32 * 32];
+    constexpr int frames = 2 * (Transition::DURATION_US / 20000 + 5);
+    int errors = 0;
+    for (uint32_t* frame : {still, moving})
+    {
+        RendererRGB888 renderer(frame, fake_clock_us);
+        srand(670);
+        fake_now_us = 0;
+        renderer.init();
+        renderer.set_quality(Q_HALF_RATE);
+        for (int n = 0; n < frames; ++n)
+        {
+            if (n == 1)
+            {
+                renderer.set_blocks(make_blocks(frame == still ? 0 : 9));
+            }
+            renderer.render(true);
+            fake_now_us += 10000;
+        }
+        if (renderer.transitioning())
+        {
+            printf("headless: half rate transition does not end\n");
+            ++errors;
+        }
+    }
+    if (background_differs(still, moving, {9}))
+    {
+        printf("headless: half rate background runs ahead in transitions\n");
+        ++errors;
+    }
+    return errors;
+}
+
+/* In P8, going stale only changes the palette; with nothing else to
+ * draw, the frame must still go out, or the display never sees it. */
+static int check_stale_p8()
+{
+    static uint8_t indexed[32 * 32];
+    int errors = 0;
+    RendererP8 renderer(indexed, fake_clock_us, fake_set_palette);
+    srand(670);
+    fake_now_us = 0;
+    renderer.init();
+    renderer.set_quality(Q_FROZEN);
+    renderer.set_blocks(make_blocks(9));
+    for (int n = 0; n < 3; ++n)
+    {
+        renderer.render(true);
+        fake_now_us += 10000;
+    }
+    int ink = palette::alert_ink(0, palette::FADE_STEPS - 1);
+    for (bool recent : {false, true})
+    {
+        int want = recent ? palette::FRESH : palette::STALE;
+        if (!renderer.render(recent)
+            || fake_palette[ink] != palette::inks[want][ink])
+        {
+            printf(
+                "headless: P8 going %s does not show\n",
+                recent ? "fresh" : "stale");
+            ++errors;
+        }
+        fake_now_us += 10000;
+        if (renderer.render(recent))
+        {
+            printf(
+                "headless: P8 %s frame changes again\n",
+                recent ? "fresh" : "stale");
+            ++errors;
+        }
+        fake_now_us += 10000;
+    }
+    return errors;
+}
+
+static void report_ns(const char* what, const bench::Result& res)
+{
+    printf(
+        "  %-36s %8llu ns\n", what,
+        static_cast<unsigned long long>(res.nanos));
+}
+
+static void report_stages()
+{
+    constexpr int frames = 20000;
+    static uint32_t frame[32 * 32];
+    const palette::BackgroundPens& pens = palette::background[palette::FRESH];
+    bench::FrameSink sink = {frame, pens.data()};
+    Surface<uint32_t> surface(frame, 32, 32);
+    FakeUnicorn unicorn;
+
+    for (int count : {9, 225})
+    {
+        std::vector<Block> blocks = make_blocks(count);
+        printf(
+            "headless: %d alerts, ns per frame, average of %d:\n", count,
+            frames);
+
+        static Background pixel;
+        srand(670);
+        pixel.init();
+        report_ns("background (pixel)", bench::measure(frames, [&]() {
+            pixel.update(sink);
+            bench::keep(frame);
+        }));
+        static BitboardBackground bitboard;
+        srand(670);
+        bitboard.init();
+        report_ns("background (bitboard)", bench::measure(frames, [&]() {
+            bitboard.update(sink);
+            bench::keep(frame);
+        }));
+
+        Layout layout;
+        report_ns("layout (per count change)", bench::measure(frames, [&]() {
+            layout.set_count(count - 1);
+            layout.set_count(count);
+        }));
+
+        Sprite<uint32_t> sprite;
+        sprite.resize(
+            layout.block_width(), layout.block_height(),
+            palette::alert[palette::FRESH][0]);
+        report_ns("blocks (on alert change)", bench::measure(frames, [&]() {
+            for (int i = 0; i < layout.count(); ++i)
+            {
+                surface.blit(sprite.surface(), layout[i].x, layout[i].y);
+            }
+            bench::keep(frame);
+        }));
+
+        Transition transition;
+        Layout old_layout;
+        std::vector<Block> old_blocks = make_blocks(count / 2);
+        old_layout.set_count(old_blocks.size());
+        report_ns(
+            "transition keyframes (per change)",
+            bench::measure(frames / 100, [&]() {
+                transition.start(old_blocks, old_layout, blocks, layout, 0);
+            }));
+        const auto& ramps = palette::alert_fade[palette::FRESH];
+        report_ns(
+            "transition draw (while animating)",
+            bench::measure(frames, [&]() {
+                transition.draw(
+                    Transition::PROGRESS_ONE / 3,
+                    [&](const BlockRect& r, int suppressed, int step) {
+                        surface.rect(
+                            r.x, r.y, r.w, r.h, ramps[suppressed][step]);
+                    });
+                bench::keep(frame);
+            }));
+
+        RendererRGB888 renderer(frame, fake_clock_us);
+        srand(670);
+        renderer.init();
+        renderer.set_blocks(blocks);
+        renderer.render(true);
+        fake_now_us += Transition::DURATION_US;
+        report_ns("render() (steady state)", bench::measure(frames, [&]() {
+            renderer.render(true);
+            fake_now_us += 10000;
+        }));
+        report_ns("present (fake unicorn)", bench::measure(frames, [&]() {
+            unicorn.update(frame);
+            bench::keep(unicorn);
+        }));
+
+        /* Going stale/fresh: every pixel in RGB888, the palette in P8. */
+        bool recent = true;
+        report_ns(
+            "render() stale/fresh (RGB888)", bench::measure(frames, [&]() {
+                recent = !recent;
+                renderer.render(recent);
+            }));
+        static uint8_t indexed[32 * 32];
+        RendererP8 p8(indexed, fake_clock_us, fake_set_palette);
+        srand(670);
+        p8.init();
+        p8.set_blocks(blocks);
+        p8.render(true);
+        report_ns(
+            "render() stale/fresh (P8)", bench::measure(frames, [&]() {
+                recent = !recent;
+                p8.render(recent);
+            }));
+        report_ns(
+            "present (P8 resolve, unicorn)", bench::measure(frames, [&]() {
+                for (int i = 0; i < 32 * 32; ++i)
+                {
+                    frame[i] = fake_palette[indexed[i]];
+                }
+                unicorn.update(frame);
+                bench::keep(unicorn);
+            }));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool update = (argc > 1 && strcmp(argv[1], "--update") == 0);
+    int errors = check_golden(update);
+    printf(
+        "headless: %d/20 frames differ from golden%s\n", errors,
+        update ? " (updated)" : "");
+    errors += check_degraded();
+    errors += check_half_rate();
+    errors += check_stale_p8();
+    if (!update)
+    {
+        report_stages();
+    }
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
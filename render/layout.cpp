@@ -0,0 +1,159 @@
+/*
+ * render/layout.cpp - part of PIM670 Zabbix Display
+ */
+
+#include <cstdlib>
+
+#include "render/layout.hpp"
+
+#ifdef RUNTESTS
+# include <algorithm>
+# include <cmath>
+# include <cstdio>
+#endif
+
+namespace render {
+
+void Layout::choose_grid(int count, int& rows, int& cols)
+{
+    int best_area = 0;
+    int best_skew = 0;
+    int best_cells = 0;
+    rows = cols = MIN_GRID;
+    for (int r = MIN_GRID; r <= MAX_GRID; ++r)
+    {
+        for (int c = MIN_GRID; c <= MAX_GRID; ++c)
+        {
+            int cells = r * c;
+            if (cells < count)
+            {
+                continue;
+            }
+            /* One pixel gap per cell, plus one at the edge. */
+            int w = (SIZE - 1) / c - 1;
+            int h = (SIZE - 1) / r - 1;
+            /* Blocks, not bars. The square grid always qualifies. */
+            if (w > 2 * h || h > 2 * w)
+            {
+                continue;
+            }
+            /* Largest blocks first, then the squarest, then the fewest
+             * empty cells. */
+            int area = w * h;
+            int skew = std::abs(w - h);
+            if (area > best_area
+                || (area == best_area
+                    && (skew < best_skew
+                        || (skew == best_skew && cells < best_cells))))
+            {
+                best_area = area;
+                best_skew = skew;
+                best_cells = cells;
+                rows = r;
+                cols = c;
+            }
+        }
+    }
+}
+
+bool Layout::set_count(int count)
+{
+    if (count > MAX_BLOCKS)
+    {
+        count = MAX_BLOCKS;
+    }
+    if (count == m_count)
+    {
+        return false;
+    }
+    m_count = count;
+    choose_grid(count, m_rows, m_cols);
+
+    int cell_w = (SIZE - 1) / m_cols;
+    int cell_h = (SIZE - 1) / m_rows;
+    m_block_w = cell_w - 1;
+    m_block_h = cell_h - 1;
+    /* Offset: when showing 9 alerts we want 1 pixel on all 4 sides,
+     * not 2 left and 2 below. */
+    int offset_x = (SIZE - 1 - m_cols * cell_w) / 2 + 1;
+    int offset_y = (SIZE - 1 - m_rows * cell_h) / 2 + 1;
+    for (int i = 0; i < count; ++i)
+    {
+        m_rects[i] = BlockRect{
+            static_cast<int8_t>(offset_x + (i % m_cols) * cell_w),
+            static_cast<int8_t>(offset_y + (i / m_cols) * cell_h),
+            static_cast<int8_t>(m_block_w), static_cast<int8_t>(m_block_h)};
+    }
+    return true;
+}
+
+} // namespace render
+
+#ifdef RUNTESTS
+using namespace render;
+
+int main()
+{
+    static Layout layout;
+    int errors = 0;
+    int bigger = 0;
+    for (int count = 0; count <= Layout::MAX_BLOCKS; ++count)
+    {
+        layout.set_count(count);
+
+        /* The square grid we used to have. */
+        int square = std::max(2, static_cast<int>(std::ceil(sqrt(count))));
+        int square_block = 31 / square - 1;
+        int area = layout.block_width() * layout.block_height();
+        if (area < square_block * square_block)
+        {
+            printf("layout: %d blocks smaller than square grid\n", count);
+            ++errors;
+        }
+        bigger += (area > square_block * square_block);
+
+        /* In bounds, with a gap all around. */
+        uint32_t used[Layout::SIZE] = {};
+        for (int i = 0; i < layout.count(); ++i)
+        {
+            const BlockRect& r = layout[i];
+            if (r.x < 1 || r.y < 1 || r.x + r.w > Layout::SIZE - 1
+                || r.y + r.h > Layout::SIZE - 1)
+            {
+                printf("layout: %d blocks, block %d outside\n", count, i);
+                ++errors;
+                break;
+            }
+            /* No other block in the block or the pixels around it. */
+            uint32_t inner = ((1u << r.w) - 1) << r.x;
+            uint32_t around = (inner << 1) | (inner >> 1) | inner;
+            for (int y = r.y - 1; y <= r.y + r.h; ++y)
+            {
+                if (used[y] & around)
+                {
+                    printf("layout: %d blocks, block %d touches\n", count, i);
+                    ++errors;
+                    break;
+                }
+            }
+            for (int y = r.y; y < r.y + r.h; ++y)
+            {
+                used[y] |= inner;
+            }
+        }
+    }
+    printf(
+        "layout: %d errors, %d/%d counts get larger blocks\n", errors, bigger,
+        Layout::MAX_BLOCKS + 1);
+    for (int count : {1, 2, 5, 10, 13, 50, 225})
+    {
+        layout.set_count(count);
+        printf(
+            "  %3d blocks: %2dx%-2d grid of %2dx%-2d\n", count, layout.rows(),
+            layout.cols(), layout.block_width(), layout.block_height());
+    }
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
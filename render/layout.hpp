@@ -0,0 +1,97 @@
+/*
+ * render/layout.hpp - part of PIM670 Zabbix Display
+ *
+ * Where the alert blocks go. The 32x32 display is split into rows x cols
+ * cells, with a 1 pixel gap around and between the blocks. Instead of the
+ * smallest square grid that fits, every rows x cols grid is considered and
+ * the one with the largest blocks wins, so e.g. 10 alerts get 3x4 cells of
+ * 6x9 pixels instead of 4x4 cells of 6x6.
+ *
+ * The rectangles are computed only when the number of blocks changes.
+ */
+#ifndef INCLUDED_RENDER_LAYOUT_HPP
+#define INCLUDED_RENDER_LAYOUT_HPP
+
+#include <cstdint>
+
+namespace render {
+
+/* What the renderer needs to know about a single alert. */
+struct Block
+{
+    /* Identifies the alert across updates, for the transitions. */
+    uint32_t id;
+    bool suppressed;
+
+    bool operator==(const Block& other) const
+    {
+        return id == other.id && suppressed == other.suppressed;
+    }
+};
+
+struct BlockRect
+{
+    int8_t x;
+    int8_t y;
+    int8_t w;
+    int8_t h;
+};
+
+class Layout
+{
+public:
+    static constexpr int SIZE = 32;
+    /* 15 x 15 blocks of 1 pixel is all that fits. */
+    static constexpr int MAX_GRID = (SIZE - 1) / 2;
+    static constexpr int MAX_BLOCKS = MAX_GRID * MAX_GRID;
+    /* Keep at least a 2x2 grid, so some background always shows. */
+    static constexpr int MIN_GRID = 2;
+
+    /* Lay out count blocks (capped at MAX_BLOCKS). Returns false if it was
+     * already laid out for count. */
+    bool set_count(int count);
+
+    int count() const
+    {
+        return m_count;
+    }
+    int rows() const
+    {
+        return m_rows;
+    }
+    int cols() const
+    {
+        return m_cols;
+    }
+    /* All blocks have the same size. */
+    int block_width() const
+    {
+        return m_block_w;
+    }
+    int block_height() const
+    {
+        return m_block_h;
+    }
+    /* Block i, row by row. */
+    const BlockRect& operator[](int i) const
+    {
+        return m_rects[i];
+    }
+
+    /* Best rows x cols for count blocks. */
+    static void choose_grid(int count, int& rows, int& cols);
+
+private:
+    int m_count = -1;
+    int m_rows = MIN_GRID;
+    int m_cols = MIN_GRID;
+    int m_block_w = 0;
+    int m_block_h = 0;
+    BlockRect m_rects[MAX_BLOCKS];
+};
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_LAYOUT_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
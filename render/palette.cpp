@@ -0,0 +1,274 @@
+/*
+ * render/palette.cpp - part of PIM670 Zabbix Display
+ */
+
+#include "render/palette.hpp"
+
+#ifdef RUNTESTS
+# include <cmath>
+# include <cstdlib>
+
+# include "render/bench.hpp"
+#endif
+
+namespace render {
+namespace palette {
+
+namespace {
+
+constexpr std::array<BackgroundPens, 2> make_background()
+{
+    std::array<BackgroundPens, 2> pens{};
+    for (int recent = 0; recent < 2; ++recent)
+    {
+        float saturation = recent ? 1.0f : 0.0f;
+        float lightness = recent ? 0.6f : 0.3f;
+        /* Level 0 stays black: that is "off". */
+        for (int level = 1; level < DECAY_LEVELS; ++level)
+        {
+            pens[recent][level] = hsv(
+                HUE_LIME, saturation,
+                lightness * static_cast<float>(level) / DECAY_UNIT);
+        }
+    }
+    return pens;
+}
+
+/* Suppressed alerts are gray, regardless of recentness. */
+constexpr float alert_saturation(int recent, int suppressed)
+{
+    return suppressed ? 0.0f : (recent ? 1.0f : 0.5f);
+}
+constexpr float alert_value(int recent, int suppressed)
+{
+    return suppressed ? 0.6f : (recent ? 1.0f : 0.6f);
+}
+
+constexpr std::array<Row<2>, 2> make_alert()
+{
+    std::array<Row<2>, 2> pens{};
+    for (int recent = 0; recent < 2; ++recent)
+    {
+        for (int suppressed = 0; suppressed < 2; ++suppressed)
+        {
+            pens[recent][suppressed] = hsv(
+                HUE_RED, alert_saturation(recent, suppressed),
+                alert_value(recent, suppressed));
+        }
+    }
+    return pens;
+}
+
+constexpr std::array<std::array<Row<FADE_STEPS>, 2>, 2> make_alert_fade()
+{
+    std::array<std::array<Row<FADE_STEPS>, 2>, 2> pens{};
+    for (int recent = 0; recent < 2; ++recent)
+    {
+        for (int suppressed = 0; suppressed < 2; ++suppressed)
+        {
+            for (int step = 0; step < FADE_STEPS; ++step)
+            {
+                pens[recent][suppressed][step] = hsv(
+                    HUE_RED, alert_saturation(recent, suppressed),
+                    alert_value(recent, suppressed)
+                        * static_cast<float>(step) / (FADE_STEPS - 1));
+            }
+        }
+    }
+    return pens;
+}
+
+constexpr std::array<Row<INKS>, 2> make_inks(
+    const std::array<BackgroundPens, 2>& background,
+    const std::array<std::array<Row<FADE_STEPS>, 2>, 2>& alert_fade)
+{
+    std::array<Row<INKS>, 2> pens{};
+    for (int recent = 0; recent < 2; ++recent)
+    {
+        for (int level = 0; level < DECAY_LEVELS; ++level)
+        {
+            pens[recent][background_ink(level)] = background[recent][level];
+        }
+        for (int suppressed = 0; suppressed < 2; ++suppressed)
+        {
+            for (int step = 0; step < FADE_STEPS; ++step)
+            {
+                pens[recent][alert_ink(suppressed, step)] =
+                    alert_fade[recent][suppressed][step];
+            }
+        }
+    }
+    return pens;
+}
+
+} // namespace
+
+/* All constexpr, so these end up in .rodata without any runtime init. */
+constexpr std::array<BackgroundPens, 2> background = make_background();
+constexpr std::array<Row<2>, 2> alert = make_alert();
+constexpr std::array<std::array<Row<FADE_STEPS>, 2>, 2> alert_fade =
+    make_alert_fade();
+constexpr std::array<Row<INKS>, 2> inks = make_inks(background, alert_fade);
+constexpr Row<2> reboot = {
+    hsv(HUE_ORANGE, 1.0f, 0.0f), hsv(HUE_ORANGE, 1.0f, 1.0f)};
+
+} // namespace palette
+} // namespace render
+
+#ifdef RUNTESTS
+using namespace render;
+
+/* This is what graphics.create_pen_hsv() does for PicoGraphics_PenRGB888. */
+__attribute__((noinline)) uint32_t create_pen_hsv(float h, float s, float v)
+{
+    float i = std::floor(h * 6.0f);
+    float f = h * 6.0f - i;
+    v *= 255.0f;
+    uint8_t p = v * (1.0f - s);
+    uint8_t q = v * (1.0f - f * s);
+    uint8_t t = v * (1.0f - (1.0f - f) * s);
+    uint8_t vv = v;
+    switch (int(i) % 6)
+    {
+    case 0:
+        return (vv << 16) | (t << 8) | p;
+    case 1:
+        return (q << 16) | (vv << 8) | p;
+    case 2:
+        return (p << 16) | (vv << 8) | t;
+    case 3:
+        return (p << 16) | (q << 8) | vv;
+    case 4:
+        return (t << 16) | (p << 8) | vv;
+    default:
+        return (vv << 16) | (p << 8) | q;
+    }
+}
+
+static int check_tables()
+{
+    int errors = 0;
+    for (int recent = 0; recent < 2; ++recent)
+    {
+        float saturation = recent ? 1.0 : 0.0;
+        float lightness = recent ? 0.6 : 0.3;
+        for (int level = 1; level < palette::DECAY_LEVELS; ++level)
+        {
+            uint32_t want = create_pen_hsv(
+                palette::HUE_LIME, saturation,
+                lightness * static_cast<float>(level) / palette::DECAY_UNIT);
+            if (palette::background[recent][level] != want)
+            {
+                printf(
+                    "background[%d][%d] = %06x, want %06x\n", recent, level,
+                    palette::background[recent][level], want);
+                ++errors;
+            }
+        }
+        if (palette::alert[recent][0]
+            != create_pen_hsv(
+                palette::HUE_RED, recent ? 1.0 : 0.5, recent ? 1.0 : 0.6))
+        {
+            printf("alert[%d][0] mismatch\n", recent);
+            ++errors;
+        }
+        if (palette::alert[recent][1]
+            != create_pen_hsv(palette::HUE_RED, 0.0, 0.6))
+        {
+            printf("alert[%d][1] mismatch\n", recent);
+            ++errors;
+        }
+        for (int suppressed = 0; suppressed < 2; ++suppressed)
+        {
+            const auto& ramp = palette::alert_fade[recent][suppressed];
+            if (ramp[0] != 0
+                || ramp[palette::FADE_STEPS - 1]
+                       != palette::alert[recent][suppressed])
+            {
+                printf("alert_fade[%d][%d] mismatch\n", recent, suppressed);
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
+
+/* The old and the new background loop, writing to a plain frame buffer. */
+static float lifetime[32][32];
+static float age[32][32];
+static uint32_t frame[32 * 32];
+
+static void reset_state()
+{
+    srand(1);
+    for (int y = 0; y < 32; ++y)
+    {
+        for (int x = 0; x < 32; ++x)
+        {
+            lifetime[x][y] = 1.0f + ((rand() % 10) / 100.0f);
+            age[x][y] = ((rand() % 100) / 100.0f) * lifetime[x][y];
+        }
+    }
+}
+
+template <typename Pen>
+static void background_frame(Pen pen)
+{
+    for (int y = 0; y < 32; ++y)
+    {
+        for (int x = 0; x < 32; ++x)
+        {
+            if (age[x][y] < lifetime[x][y] * 0.3f)
+            {
+                frame[y * 32 + x] = pen(1.0f);
+            }
+            else if (age[x][y] < lifetime[x][y] * 0.5f)
+            {
+                frame[y * 32 + x] =
+                    pen((lifetime[x][y] * 0.5f - age[x][y]) * 5.0f);
+            }
+            if (age[x][y] >= lifetime[x][y])
+            {
+                age[x][y] = 0.0f;
+                lifetime[x][y] = 1.0f + ((rand() % 10) / 100.0f);
+            }
+            age[x][y] += 0.01f;
+        }
+    }
+    bench::keep(frame);
+}
+
+int main()
+{
+    int errors = check_tables();
+    printf("palette: %d table mismatches\n", errors);
+
+    constexpr int frames = 20000;
+    volatile bool recent = true;
+    float saturation = recent ? 1.0 : 0.0;
+    float lightness = recent ? 0.6 : 0.3;
+
+    reset_state();
+    bench::Result before = bench::measure(frames, [=]() {
+        background_frame([=](float decay) {
+            return create_pen_hsv(
+                palette::HUE_LIME, saturation, lightness * decay);
+        });
+    });
+
+    reset_state();
+    const palette::BackgroundPens& pens = palette::background[recent];
+    bench::Result after = bench::measure(frames, [&]() {
+        background_frame([&](float decay) {
+            return pens[palette::decay_level(decay)];
+        });
+    });
+
+    printf("palette: background frame (32x32), average of %d:\n", frames);
+    bench::report("create_pen_hsv() per lit pixel", before);
+    bench::report("palette table lookup", after);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,125 @@
+/*
+ * render/palette.hpp - part of PIM670 Zabbix Display
+ *
+ * Precomputed RGB888 pens for everything we draw. The Cortex-M0+ has no FPU,
+ * so create_pen_hsv() costs a few hundred cycles of soft-float per call. All
+ * colours we use are known at compile time; we build them once, here.
+ */
+#ifndef INCLUDED_RENDER_PALETTE_HPP
+#define INCLUDED_RENDER_PALETTE_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace render {
+namespace palette {
+
+/* Background fade: lightness * decay, where decay = level / DECAY_UNIT.
+ * With lifetimes of 1.00..1.09 s the decay can slightly exceed 1.0, so the
+ * table goes up to DECAY_LEVELS - 1 = 44 (decay 1.1). Level 0 is "off". */
+constexpr int DECAY_UNIT = 40;
+constexpr int DECAY_LEVELS = 45;
+
+/* Alert fade-in/out ramp: step 0 is black, FADE_STEPS - 1 the alert pen. */
+constexpr int FADE_STEPS = 16;
+
+/* Indexes for the has_recent_data state. */
+constexpr int STALE = 0;
+constexpr int FRESH = 1;
+
+/* Same algorithm as pimoroni::RGB::from_hsv(...).to_rgb888(), but usable in
+ * constant expressions. Hue is 0..1, not 0..360. */
+constexpr uint32_t hsv(float h, float s, float v)
+{
+    int i = static_cast<int>(h * 6.0f); /* floor(), we have h >= 0 */
+    float f = h * 6.0f - static_cast<float>(i);
+    v *= 255.0f;
+    uint32_t vv = static_cast<uint8_t>(v);
+    uint32_t p = static_cast<uint8_t>(v * (1.0f - s));
+    uint32_t q = static_cast<uint8_t>(v * (1.0f - f * s));
+    uint32_t t = static_cast<uint8_t>(v * (1.0f - (1.0f - f) * s));
+    switch (i % 6)
+    {
+    case 0:
+        return (vv << 16) | (t << 8) | p;
+    case 1:
+        return (q << 16) | (vv << 8) | p;
+    case 2:
+        return (p << 16) | (vv << 8) | t;
+    case 3:
+        return (p << 16) | (q << 8) | vv;
+    case 4:
+        return (t << 16) | (p << 8) | vv;
+    default:
+        return (vv << 16) | (p << 8) | q;
+    }
+}
+
+constexpr float hue(float hue360)
+{
+    return hue360 / 360.0f;
+}
+
+constexpr float HUE_RED = hue(0);
+constexpr float HUE_ORANGE = hue(30);
+constexpr float HUE_YELLOW = hue(60);
+constexpr float HUE_LIME = hue(90);
+constexpr float HUE_GREEN = hue(120);
+
+template <int N>
+using Row = std::array<uint32_t, N>;
+using BackgroundPens = Row<DECAY_LEVELS>;
+
+/* Background ("eighties super computer") pens: [recent][level]. */
+extern const std::array<BackgroundPens, 2> background;
+
+/* Alert block pens: [recent][suppressed]. */
+extern const std::array<Row<2>, 2> alert;
+
+/* Alert block fade ramps: [recent][suppressed][step]. */
+extern const std::array<std::array<Row<FADE_STEPS>, 2>, 2> alert_fade;
+
+/* Everything the renderer draws with, as one indexed palette ("inks"):
+ * the background levels, then the alert ramps. In RGB888 mode an ink is
+ * looked up here; in P8 mode it is the palette index, and switching
+ * between stale and fresh only rewrites the palette. */
+constexpr int INK_BACKGROUND = 0;
+constexpr int INK_ALERT = INK_BACKGROUND + DECAY_LEVELS;
+constexpr int INKS = INK_ALERT + 2 * FADE_STEPS;
+
+constexpr int background_ink(int level)
+{
+    return INK_BACKGROUND + level;
+}
+constexpr int alert_ink(int suppressed, int step)
+{
+    return INK_ALERT + suppressed * FADE_STEPS + step;
+}
+
+/* Ink pens: [recent][ink]. */
+extern const std::array<Row<INKS>, 2> inks;
+
+/* Reboot notification (orange) pens: [lit]. */
+extern const Row<2> reboot;
+
+/* Map a float decay (0..1.1) onto a background level. */
+inline int decay_level(float decay)
+{
+    int level = static_cast<int>(decay * DECAY_UNIT + 0.5f);
+    if (level < 0)
+    {
+        return 0;
+    }
+    if (level >= DECAY_LEVELS)
+    {
+        return DECAY_LEVELS - 1;
+    }
+    return level;
+}
+
+} // namespace palette
+} // namespace render
+
+#endif // INCLUDED_RENDER_PALETTE_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,208 @@
+/*
+ * render/raster.cpp - part of PIM670 Zabbix Display
+ *
+ * The raster primitives live in render/raster.hpp; this holds their tests
+ * and the benchmark against the PicoGraphics way of drawing.
+ */
+#include "render/raster.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+
+# include "render/bench.hpp"
+#endif
+
+#ifdef RUNTESTS
+using namespace render;
+
+/* What PicoGraphics_PenRGB888 does for every pixel(Point): a clip against
+ * the bounds and a virtual call into the pen type. */
+class PicoGraphicsLike
+{
+public:
+    PicoGraphicsLike(uint32_t* frame, int width, int height)
+        : m_frame(frame), m_width(width), m_height(height)
+    {
+    }
+    virtual ~PicoGraphicsLike()
+    {
+    }
+
+    void set_pen(uint32_t color)
+    {
+        m_color = color;
+    }
+    void pixel(int x, int y)
+    {
+        if (x >= 0 && y >= 0 && x < m_width && y < m_height)
+        {
+            set_pixel(x, y);
+        }
+    }
+    virtual void set_pixel(int x, int y)
+    {
+        m_frame[y * m_width + x] = m_color;
+    }
+
+private:
+    uint32_t* m_frame;
+    int m_width;
+    int m_height;
+    uint32_t m_color = 0;
+};
+
+static int check(const char* what, const uint32_t* expected, uint32_t* frame)
+{
+    if (memcmp(expected, frame, 32 * 32 * sizeof(uint32_t)) != 0)
+    {
+        printf("raster: %s differs from per-pixel drawing\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+static void report_rate(const char* what, const bench::Result& res, int pixels)
+{
+    double nanos = res.nanos ? res.nanos : 1;
+    printf(
+        "  %-36s %8llu ns %8.1f Mpx/s\n", what,
+        static_cast<unsigned long long>(res.nanos), pixels * 1e3 / nanos);
+}
+
+int main()
+{
+    static uint32_t expected[32 * 32];
+    static uint32_t frame[32 * 32];
+    PicoGraphicsLike graphics(expected, 32, 32);
+    Surface<uint32_t> surface(frame, 32, 32);
+    int errors = 0;
+
+    /* Rectangles, partly off-screen. */
+    const int rects[][4] = {{1, 1, 14, 14}, {-3, 20, 8, 20}, {28, -2, 9, 5}};
+    for (const auto& r : rects)
+    {
+        graphics.set_pen(0x123456);
+        for (int h = r[1]; h < r[1] + r[3]; ++h)
+        {
+            for (int w = r[0]; w < r[0] + r[2]; ++w)
+            {
+                graphics.pixel(w, h);
+            }
+        }
+        surface.rect(r[0], r[1], r[2], r[3], 0x123456);
+    }
+    errors += check("rect", expected, frame);
+
+    /* Bit masks, including both edges. */
+    const uint32_t masks[] = {0x80000001, 0xffffffff, 0x0ff0f00e, 0};
+    for (int y = 0; y < 32; ++y)
+    {
+        uint32_t bits = masks[y % 4] ^ (y << 8);
+        graphics.set_pen(0x00ff00 + y);
+        for (int x = 0; x < 32; ++x)
+        {
+            if (bits & (1u << x))
+            {
+                graphics.pixel(x, y);
+            }
+        }
+        surface.mask(y, bits, 0x00ff00 + y);
+    }
+    errors += check("mask", expected, frame);
+
+    /* Sprites, partly off-screen. */
+    Sprite<uint32_t> sprite;
+    sprite.resize(9, 9, 0xabcdef);
+    const int spots[][2] = {{3, 3}, {-4, 12}, {27, 28}};
+    for (const auto& s : spots)
+    {
+        graphics.set_pen(0xabcdef);
+        for (int h = s[1]; h < s[1] + 9; ++h)
+        {
+            for (int w = s[0]; w < s[0] + 9; ++w)
+            {
+                graphics.pixel(w, h);
+            }
+        }
+        surface.blit(sprite.surface(), s[0], s[1]);
+    }
+    errors += check("blit", expected, frame);
+    printf("raster: %d errors\n", errors);
+
+    /* The alert grid with 9 blocks of 9x9. */
+    constexpr int iterations = 100000;
+    constexpr int grid_pixels = 9 * 9 * 9;
+    bench::Result before = bench::measure(iterations, [&]() {
+        graphics.set_pen(0xff0000);
+        for (int y = 1; y < 31; y += 10)
+        {
+            for (int x = 1; x < 31; x += 10)
+            {
+                for (int h = y; h < y + 9; ++h)
+                {
+                    for (int w = x; w < x + 9; ++w)
+                    {
+                        graphics.pixel(w, h);
+                    }
+                }
+            }
+        }
+        bench::keep(expected);
+    });
+    bench::Result rect = bench::measure(iterations, [&]() {
+        for (int y = 1; y < 31; y += 10)
+        {
+            for (int x = 1; x < 31; x += 10)
+            {
+                surface.rect(x, y, 9, 9, 0xff0000);
+            }
+        }
+        bench::keep(frame);
+    });
+    bench::Result blit = bench::measure(iterations, [&]() {
+        for (int y = 1; y < 31; y += 10)
+        {
+            for (int x = 1; x < 31; x += 10)
+            {
+                surface.blit(sprite.surface(), x, y);
+            }
+        }
+        bench::keep(frame);
+    });
+    printf("raster: 9 blocks of 9x9, average of %d:\n", iterations);
+    report_rate("pixel(Point) (PicoGraphics)", before, grid_pixels);
+    report_rate("rect (render::Surface)", rect, grid_pixels);
+    report_rate("sprite blit (render::Surface)", blit, grid_pixels);
+
+    /* A background row mask with half the cells set. */
+    constexpr int mask_pixels = 32 * 16;
+    before = bench::measure(iterations, [&]() {
+        for (int y = 0; y < 32; ++y)
+        {
+            uint32_t bits = 0x0ff00ff0u >> (y & 3);
+            for (int x = 0; x < 32; ++x)
+            {
+                if (bits & (1u << x))
+                {
+                    graphics.pixel(x, y);
+                }
+            }
+        }
+        bench::keep(expected);
+    });
+    bench::Result mask = bench::measure(iterations, [&]() {
+        for (int y = 0; y < 32; ++y)
+        {
+            surface.mask(y, 0x0ff00ff0u >> (y & 3), 0x00ff00);
+        }
+        bench::keep(frame);
+    });
+    printf(
+        "raster: 32 rows of 16 masked pixels, average of %d:\n", iterations);
+    report_rate("pixel(Point) (PicoGraphics)", before, mask_pixels);
+    report_rate("mask (render::Surface)", mask, mask_pixels);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,146 @@
+/*
+ * render/raster.hpp - part of PIM670 Zabbix Display
+ *
+ * Minimal raster primitives straight on a frame buffer. PicoGraphics draws
+ * everything through a virtual set_pixel() with clipping per pixel; here
+ * we clip once per span/rectangle and write whole rows.
+ */
+#ifndef INCLUDED_RENDER_RASTER_HPP
+#define INCLUDED_RENDER_RASTER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace render {
+
+template <typename Pixel>
+class Surface
+{
+public:
+    Surface(void* buffer, int width, int height)
+        : m_pixels(static_cast<Pixel*>(buffer)), m_width(width),
+          m_height(height)
+    {
+    }
+
+    int width() const
+    {
+        return m_width;
+    }
+    int height() const
+    {
+        return m_height;
+    }
+    Pixel* row(int y)
+    {
+        return m_pixels + y * m_width;
+    }
+    const Pixel* row(int y) const
+    {
+        return m_pixels + y * m_width;
+    }
+
+    /* Single pixel, NOT clipped. */
+    void pixel(int x, int y, Pixel color)
+    {
+        m_pixels[y * m_width + x] = color;
+    }
+
+    /* Pixels x0 up to (not including) x1 on row y. */
+    void span(int y, int x0, int x1, Pixel color)
+    {
+        if (y < 0 || y >= m_height)
+        {
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, m_width);
+        if (x0 < x1)
+        {
+            std::fill_n(row(y) + x0, x1 - x0, color);
+        }
+    }
+
+    void rect(int x, int y, int w, int h, Pixel color)
+    {
+        int y1 = std::min(y + h, m_height);
+        for (y = std::max(y, 0); y < y1; ++y)
+        {
+            span(y, x, x + w, color);
+        }
+    }
+
+    /* Pixels for all set bits (bit n is x = n) on row y; runs of bits
+     * become spans. For surfaces up to 32 pixels wide. */
+    void mask(int y, uint32_t bits, Pixel color)
+    {
+        while (bits)
+        {
+            int x0 = __builtin_ctz(bits);
+            uint32_t rest = ~(bits >> x0);
+            int len = rest ? __builtin_ctz(rest) : 32;
+            span(y, x0, x0 + len, color);
+            bits &= (len + x0 >= 32) ? 0 : (~0u << (x0 + len));
+        }
+    }
+
+    /* Copy all of src with its top left at x, y. */
+    void blit(const Surface& src, int x, int y)
+    {
+        int x0 = std::max(x, 0);
+        int x1 = std::min(x + src.width(), m_width);
+        int y1 = std::min(y + src.height(), m_height);
+        if (x0 >= x1)
+        {
+            return;
+        }
+        for (int dy = std::max(y, 0); dy < y1; ++dy)
+        {
+            memcpy(
+                row(dy) + x0, src.row(dy - y) + (x0 - x),
+                (x1 - x0) * sizeof(Pixel));
+        }
+    }
+
+private:
+    Pixel* m_pixels;
+    int m_width;
+    int m_height;
+};
+
+/* A small pre-rendered image, to blit() onto a Surface. */
+template <typename Pixel>
+class Sprite
+{
+public:
+    /* (Re)allocate and clear to color. */
+    void resize(int width, int height, Pixel color)
+    {
+        m_pixels.assign(width * height, color);
+        m_width = width;
+        m_height = height;
+    }
+
+    Surface<Pixel> surface()
+    {
+        return Surface<Pixel>(m_pixels.data(), m_width, m_height);
+    }
+    const Surface<Pixel> surface() const
+    {
+        return Surface<Pixel>(
+            const_cast<Pixel*>(m_pixels.data()), m_width, m_height);
+    }
+
+private:
+    std::vector<Pixel> m_pixels;
+    int m_width = 0;
+    int m_height = 0;
+};
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_RASTER_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,309 @@
+/*
+ * render/renderer.cpp - part of PIM670 Zabbix Display
+ */
+
+#include "opt/placement.h"
+#include "render/renderer.hpp"
+
+namespace render {
+
+template <typename Pixel>
+PixelRenderer<Pixel>::PixelRenderer(
+    void* frame_buffer, Clock clock_us, PaletteWriter set_palette)
+    : m_surface(frame_buffer, WIDTH, HEIGHT), m_clock_us(clock_us),
+      m_set_palette(set_palette)
+{
+    if (INDEXED)
+    {
+        /* The palette does the mapping; see set_recent(). */
+        for (int ink = 0; ink < palette::INKS; ++ink)
+        {
+            m_pens[ink] = ink;
+        }
+    }
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::init()
+{
+    m_background.init();
+    m_bitboard.init();
+    layout();
+    invalidate();
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::set_background_engine(BackgroundEngine engine)
+{
+    if (engine != m_engine)
+    {
+        /* The other engine has its own state; it must repaint it all. */
+        m_engine = engine;
+        invalidate_background();
+    }
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::set_blocks(const std::vector<Block>& blocks)
+{
+    if (blocks == m_blocks)
+    {
+        return;
+    }
+    if (m_recent >= 0 && m_quality < Q_NO_TRANSITIONS)
+    {
+        /* Animate from what is on display. A transition that is still
+         * running is cut short: we start from where it was going. */
+        m_old_layout = m_layout;
+        m_layout.set_count(blocks.size());
+        m_transition.start(
+            m_blocks, m_old_layout, blocks, m_layout, m_clock_us());
+    }
+    bool resized = (blocks.size() != m_blocks.size());
+    m_blocks = blocks;
+    m_blocks_dirty = true;
+    if (resized)
+    {
+        /* Blocks moved, so the background shows elsewhere now. */
+        layout();
+        render_sprites();
+        invalidate_background();
+    }
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::set_quality(Quality quality)
+{
+    m_quality = quality;
+    if (quality >= Q_NO_TRANSITIONS && m_transition.active())
+    {
+        end_transition();
+    }
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::invalidate()
+{
+    m_blocks_dirty = true;
+    invalidate_background();
+}
+
+template <typename Pixel>
+HOT_PATH("render") bool PixelRenderer<Pixel>::render(bool has_recent_data)
+{
+    uint32_t frame_start = m_clock_us();
+    /* Before set_recent(): in P8 the new palette is the change. */
+    m_changed = false;
+    int recent = has_recent_data ? palette::FRESH : palette::STALE;
+    if (recent != m_recent)
+    {
+        set_recent(recent);
+    }
+
+    int progress = Transition::PROGRESS_ONE;
+    if (m_transition.active())
+    {
+        progress = m_transition.progress(frame_start);
+        if (progress == Transition::PROGRESS_ONE)
+        {
+            end_transition();
+        }
+    }
+    bool animating = m_transition.active();
+    if (animating)
+    {
+        /* The blocks move over the background: repaint all of it. */
+        invalidate_background();
+    }
+    m_use_covered = !animating;
+
+    /* Update eighties super computer; under load, less often. */
+    ++m_frame;
+    bool skip = (m_quality >= Q_FROZEN)
+                || (m_quality >= Q_HALF_RATE && (m_frame & 1));
+    if (!skip || m_background_dirty)
+    {
+        /* A skipped frame still repaints what blocks uncovered, but the
+         * background stands still. */
+        BackgroundSink sink = {*this};
+        if (m_engine == BG_BITBOARD)
+        {
+            m_bitboard.update(sink, !skip);
+        }
+        else
+        {
+            m_background.update(sink, !skip);
+        }
+        m_background_dirty = false;
+    }
+
+    if (animating)
+    {
+        m_transition.draw(
+            progress, [&](const BlockRect& rect, int suppressed, int step) {
+                m_surface.rect(
+                    rect.x, rect.y, rect.w, rect.h,
+                    m_pens[palette::alert_ink(suppressed, step)]);
+            });
+        m_changed = true;
+
+        /* Rather show the end result than slow down the frame rate. */
+        if (m_clock_us() - frame_start > m_frame_budget_us)
+        {
+            if (++m_over_budget >= OVER_BUDGET_FRAMES)
+            {
+                end_transition();
+                /* Only this core writes it. */
+                m_transitions_cut.store(
+                    m_transitions_cut.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            m_over_budget = 0;
+        }
+    }
+    else if (m_blocks_dirty)
+    {
+        /* Write static rectangles for all alerts. */
+        draw_blocks();
+        m_blocks_dirty = false;
+        m_changed = true;
+    }
+
+    return m_changed;
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::set_recent(int recent)
+{
+    bool first = (m_recent < 0);
+    m_recent = recent;
+    if (INDEXED)
+    {
+        /* Only the palette changes; the pixels stay as they are. */
+        for (int ink = 0; ink < palette::INKS; ++ink)
+        {
+            m_set_palette(ink, palette::inks[recent][ink]);
+        }
+        m_changed = true;
+        if (!first)
+        {
+            return;
+        }
+    }
+    else
+    {
+        /* All pens change. */
+        for (int ink = 0; ink < palette::INKS; ++ink)
+        {
+            m_pens[ink] = palette::inks[recent][ink];
+        }
+    }
+    render_sprites();
+    invalidate();
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::layout()
+{
+    m_layout.set_count(m_blocks.size());
+
+    /* Record which pixels the blocks cover. */
+    for (int y = 0; y < HEIGHT; ++y)
+    {
+        m_covered[y] = 0;
+    }
+    for (int i = 0; i < m_layout.count(); ++i)
+    {
+        const BlockRect& rect = m_layout[i];
+        uint32_t bits = ((1u << rect.w) - 1) << rect.x;
+        for (int y = rect.y; y < rect.y + rect.h; ++y)
+        {
+            m_covered[y] |= bits;
+        }
+    }
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::render_sprites()
+{
+    if (m_recent < 0)
+    {
+        return; /* no pens yet; render() calls us again */
+    }
+    constexpr int full = palette::FADE_STEPS - 1;
+    for (int suppressed = 0; suppressed < 2; ++suppressed)
+    {
+        m_block_sprites[suppressed].resize(
+            m_layout.block_width(), m_layout.block_height(),
+            m_pens[palette::alert_ink(suppressed, full)]);
+    }
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::draw_blocks()
+{
+    for (int i = 0; i < m_layout.count(); ++i)
+    {
+        const Sprite<Pixel>& sprite =
+            m_block_sprites[m_blocks[i].suppressed ? 1 : 0];
+        m_surface.blit(sprite.surface(), m_layout[i].x, m_layout[i].y);
+    }
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::end_transition()
+{
+    m_transition.finish();
+    m_over_budget = 0;
+    /* Blocks where the layout says, background where the animation
+     * was. */
+    m_blocks_dirty = true;
+    invalidate_background();
+}
+
+template <typename Pixel>
+void PixelRenderer<Pixel>::invalidate_background()
+{
+    m_background.invalidate();
+    m_bitboard.invalidate();
+    m_background_dirty = true;
+}
+
+/* Per pixel or row of the background, every frame. */
+template <typename Pixel>
+HOT_PATH("render") void PixelRenderer<Pixel>::plot_background(
+    int x, int y, int level)
+{
+    /* Covered by an alert block; no need to draw. */
+    if (m_use_covered && (m_covered[y] & (1u << x)))
+    {
+        return;
+    }
+    m_surface.pixel(x, y, m_pens[palette::background_ink(level)]);
+    m_changed = true;
+}
+
+template <typename Pixel>
+HOT_PATH("render") void PixelRenderer<Pixel>::fill_background(
+    int y, uint32_t mask, int level)
+{
+    if (m_use_covered)
+    {
+        mask &= ~m_covered[y];
+    }
+    if (mask)
+    {
+        m_surface.mask(y, mask, m_pens[palette::background_ink(level)]);
+        m_changed = true;
+    }
+}
+
+template class PixelRenderer<uint32_t>;
+template class PixelRenderer<uint8_t>;
+
+} // namespace render
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,203 @@
+/*
+ * render/renderer.hpp - part of PIM670 Zabbix Display
+ *
+ * Composes the background and the alert blocks into a 32x32 frame buffer,
+ * touching only what changed since the previous frame:
+ *
+ * - the alert layer is redrawn only if the alerts or has_recent_data
+ *   changed;
+ * - the background engines report only cells that changed level, and
+ *   cells under an alert block are skipped;
+ * - render() tells the caller whether the frame changed at all, so it
+ *   can skip pushing an identical frame to the display.
+ *
+ * When the alerts change, the blocks animate to their new places (see
+ * render/transition.hpp). Animating frames repaint the whole background;
+ * if they keep taking longer than the frame budget, the animation is cut
+ * short and the end result shown at once.
+ *
+ * Under load, the caller can lower the quality (see
+ * render/framebudget.hpp): the background then moves less or not at all
+ * and alert changes no longer animate, but they still show at once.
+ *
+ * Two frame formats: RGB888 (that of PicoGraphics_PenRGB888, 4 KiB) and
+ * P8 (PicoGraphics_PenP8, 1 KiB). In P8 the renderer writes palette
+ * indexes ("inks", see render/palette.hpp); the display resolves them to
+ * RGB when it gets the frame, and going stale or fresh only rewrites the
+ * palette instead of every pixel.
+ */
+#ifndef INCLUDED_RENDER_RENDERER_HPP
+#define INCLUDED_RENDER_RENDERER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "render/background.hpp"
+#include "render/bitboard.hpp"
+#include "render/framebudget.hpp"
+#include "render/layout.hpp"
+#include "render/palette.hpp"
+#include "render/raster.hpp"
+#include "render/transition.hpp"
+
+namespace render {
+
+typedef enum BackgroundEngines
+{
+    BG_PIXEL = 0,
+    BG_BITBOARD
+} BackgroundEngine;
+
+typedef enum FrameFormats
+{
+    FRAME_RGB888 = 0,
+    FRAME_P8
+} FrameFormat;
+
+/* The part that does not depend on the frame format, so the caller can
+ * pick one at run time. */
+class Renderer
+{
+public:
+    static constexpr int WIDTH = Background::WIDTH;
+    static constexpr int HEIGHT = Background::HEIGHT;
+
+    /* Transitions are cut short after this many frames over budget in a
+     * row. */
+    static constexpr int OVER_BUDGET_FRAMES = 2;
+
+    /* A free running microsecond clock, like time_us_32(). */
+    typedef uint32_t (*Clock)();
+    /* P8 only: set palette entry index to an RGB888 colour. */
+    typedef void (*PaletteWriter)(int index, uint32_t rgb);
+
+    virtual ~Renderer()
+    {
+    }
+
+    /* Randomize both background engines; no blocks yet. */
+    virtual void init() = 0;
+
+    virtual void set_background_engine(BackgroundEngine engine) = 0;
+    /* Animates to the new blocks, unless nothing was rendered yet. */
+    virtual void set_blocks(const std::vector<Block>& blocks) = 0;
+    /* Time a frame may take while animating. */
+    virtual void set_frame_budget_us(uint32_t budget_us) = 0;
+    /* From the next frame on. */
+    virtual void set_quality(Quality quality) = 0;
+
+    virtual bool transitioning() const = 0;
+    /* Transitions cut short for going over budget; safe to read from
+     * the other core. */
+    virtual uint32_t transitions_cut() const = 0;
+
+    /* Redraw everything on the next render(), e.g. after someone else
+     * drew on the frame buffer. */
+    virtual void invalidate() = 0;
+
+    /* Draw the next frame. Returns false if the frame buffer is the same
+     * as after the previous call. */
+    virtual bool render(bool has_recent_data) = 0;
+};
+
+/* Pixel is uint32_t for RGB888 and uint8_t for P8. */
+template <typename Pixel>
+class PixelRenderer final : public Renderer
+{
+public:
+    static constexpr bool INDEXED = (sizeof(Pixel) == 1);
+
+    /* set_palette is required for P8 and ignored for RGB888. */
+    PixelRenderer(
+        void* frame_buffer, Clock clock_us,
+        PaletteWriter set_palette = nullptr);
+
+    void init() override;
+    void set_background_engine(BackgroundEngine engine) override;
+    void set_blocks(const std::vector<Block>& blocks) override;
+    void set_frame_budget_us(uint32_t budget_us) override
+    {
+        m_frame_budget_us = budget_us;
+    }
+    void set_quality(Quality quality) override;
+    bool transitioning() const override
+    {
+        return m_transition.active();
+    }
+    uint32_t transitions_cut() const override
+    {
+        return m_transitions_cut.load(std::memory_order_relaxed);
+    }
+    void invalidate() override;
+    bool render(bool has_recent_data) override;
+
+private:
+    /* Where the background engines report changed cells. */
+    struct BackgroundSink
+    {
+        PixelRenderer& renderer;
+
+        void plot(int x, int y, int level)
+        {
+            renderer.plot_background(x, y, level);
+        }
+        void fill(int y, uint32_t mask, int level)
+        {
+            renderer.fill_background(y, mask, level);
+        }
+    };
+
+    void set_recent(int recent);
+    void layout();
+    void render_sprites();
+    void draw_blocks();
+    void end_transition();
+    void invalidate_background();
+    void plot_background(int x, int y, int level);
+    void fill_background(int y, uint32_t mask, int level);
+
+    Surface<Pixel> m_surface;
+    Clock m_clock_us;
+    PaletteWriter m_set_palette;
+    BackgroundEngine m_engine = BG_PIXEL;
+    Background m_background;
+    BitboardBackground m_bitboard;
+
+    std::vector<Block> m_blocks;
+    int m_recent = -1;
+    bool m_blocks_dirty = true;
+    bool m_changed = false;
+    /* What to write for each ink: the colour for RGB888, the palette
+     * index itself for P8. */
+    Pixel m_pens[palette::INKS] = {};
+
+    /* Block rectangles; recomputed when the number of blocks changes. */
+    Layout m_layout;
+    Layout m_old_layout;
+    /* Pixels covered by alert blocks, one bit per pixel. Not used while
+     * animating: the blocks are not where the layout says. */
+    uint32_t m_covered[HEIGHT] = {};
+    bool m_use_covered = true;
+    /* Pre-rendered blocks: [suppressed]. */
+    Sprite<Pixel> m_block_sprites[2];
+
+    Transition m_transition;
+    uint32_t m_frame_budget_us = 5000;
+    int m_over_budget = 0;
+    std::atomic<uint32_t> m_transitions_cut{0};
+
+    Quality m_quality = Q_FULL;
+    uint32_t m_frame = 0;
+    /* The background must be repainted, even if it stands still. */
+    bool m_background_dirty = true;
+};
+
+typedef PixelRenderer<uint32_t> RendererRGB888;
+typedef PixelRenderer<uint8_t> RendererP8;
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_RENDERER_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
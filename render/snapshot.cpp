@@ -0,0 +1,152 @@
+/*
+ * render/snapshot.cpp - part of PIM670 Zabbix Display
+ */
+
+#include <algorithm>
+
+#include "render/snapshot.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+#endif
+
+namespace render {
+
+/* Little endian, whatever the host, so the tests read what the device
+ * wrote. */
+static void put32(uint8_t* buf, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        buf[i] = value >> (8 * i);
+    }
+}
+
+static uint32_t get32(const uint8_t* buf)
+{
+    return buf[0] | buf[1] << 8 | buf[2] << 16
+           | static_cast<uint32_t>(buf[3]) << 24;
+}
+
+/* FNV-1a; erased flash (all ones) does not pass it. */
+uint32_t Snapshot::checksum(const uint8_t* buf, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ buf[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Header: magic, seq, count, checksum of all but the checksum. */
+size_t Snapshot::encode(
+    const std::vector<Block>& blocks, uint32_t seq, uint8_t* buf)
+{
+    size_t count = std::min<size_t>(blocks.size(), Layout::MAX_BLOCKS);
+    put32(buf, MAGIC);
+    put32(buf + 4, seq);
+    put32(buf + 8, count);
+    uint8_t* pos = buf + HEADER_SIZE;
+    for (size_t i = 0; i < count; ++i, pos += BLOCK_SIZE)
+    {
+        put32(pos, blocks[i].id);
+        put32(pos + 4, blocks[i].suppressed);
+    }
+    size_t size = pos - buf;
+    uint32_t sum =
+        checksum(buf, 12) ^ checksum(buf + HEADER_SIZE, size - HEADER_SIZE);
+    put32(buf + 12, sum);
+    return size;
+}
+
+bool Snapshot::decode(
+    const uint8_t* buf, size_t size, uint32_t& seq,
+    std::vector<Block>& blocks)
+{
+    if (size < HEADER_SIZE || get32(buf) != MAGIC)
+    {
+        return false;
+    }
+    uint32_t count = get32(buf + 8);
+    if (count > Layout::MAX_BLOCKS || HEADER_SIZE + count * BLOCK_SIZE > size)
+    {
+        return false;
+    }
+    size_t body = count * BLOCK_SIZE;
+    if (get32(buf + 12)
+        != (checksum(buf, 12) ^ checksum(buf + HEADER_SIZE, body)))
+    {
+        return false;
+    }
+    seq = get32(buf + 4);
+    blocks.clear();
+    for (const uint8_t* pos = buf + HEADER_SIZE; count; --count)
+    {
+        blocks.push_back(Block{get32(pos), get32(pos + 4) != 0});
+        pos += BLOCK_SIZE;
+    }
+    return true;
+}
+
+} // namespace render
+
+#ifdef RUNTESTS
+using namespace render;
+
+int main()
+{
+    int errors = 0;
+    uint8_t buf[Snapshot::MAX_SIZE];
+    std::vector<Block> blocks;
+    for (uint32_t i = 0; i < 300; ++i)
+    {
+        blocks.push_back(Block{i * 2654435761u, (i % 3) == 0});
+    }
+
+    /* Round trip, capped at what fits on the display. */
+    size_t size = Snapshot::encode(blocks, 42, buf);
+    std::vector<Block> back;
+    uint32_t seq = 0;
+    if (size != Snapshot::MAX_SIZE
+        || !Snapshot::decode(buf, sizeof(buf), seq, back) || seq != 42
+        || back.size() != Layout::MAX_BLOCKS
+        || !std::equal(back.begin(), back.end(), blocks.begin()))
+    {
+        printf("snapshot: %zu blocks did not round trip\n", blocks.size());
+        ++errors;
+    }
+
+    /* No alerts is a state too. */
+    size = Snapshot::encode(std::vector<Block>(), 43, buf);
+    if (!Snapshot::decode(buf, size, seq, back) || seq != 43 || !back.empty())
+    {
+        printf("snapshot: empty snapshot did not round trip\n");
+        ++errors;
+    }
+
+    /* Erased flash, a flipped bit or a short read: nothing, and the
+     * blocks stay as they were. */
+    back = blocks;
+    std::fill(buf, buf + sizeof(buf), 0xff);
+    bool erased = Snapshot::decode(buf, sizeof(buf), seq, back);
+    size = Snapshot::encode(blocks, 44, buf);
+    buf[100] ^= 0x10;
+    bool flipped = Snapshot::decode(buf, size, seq, back);
+    buf[100] ^= 0x10;
+    bool short_read = Snapshot::decode(buf, size - 1, seq, back);
+    if (erased || flipped || short_read || back.size() != blocks.size()
+        || seq != 43)
+    {
+        printf(
+            "snapshot: decoded erased %d, flipped %d, short %d\n", erased,
+            flipped, short_read);
+        ++errors;
+    }
+
+    printf("snapshot: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,53 @@
+/*
+ * render/snapshot.hpp - part of PIM670 Zabbix Display
+ *
+ * The alert blocks as kept in flash, so that after a (re)boot the display
+ * shows the last known alerts at once, instead of nothing until WiFi is
+ * up and Zabbix answered.
+ *
+ * Snapshots go into a ring of flash sectors. Each carries a sequence
+ * number and a checksum: at boot the newest valid one wins, and a torn
+ * write only loses that one snapshot.
+ */
+#ifndef INCLUDED_RENDER_SNAPSHOT_HPP
+#define INCLUDED_RENDER_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "render/layout.hpp"
+
+namespace render {
+
+class Snapshot
+{
+public:
+    /* Header plus Layout::MAX_BLOCKS blocks fit in a flash sector. */
+    static constexpr size_t HEADER_SIZE = 16;
+    static constexpr size_t BLOCK_SIZE = 8;
+    static constexpr size_t MAX_SIZE =
+        HEADER_SIZE + Layout::MAX_BLOCKS * BLOCK_SIZE;
+
+    /* Write blocks (up to Layout::MAX_BLOCKS) with sequence number seq
+     * into buf of MAX_SIZE. Returns the bytes used. */
+    static size_t encode(
+        const std::vector<Block>& blocks, uint32_t seq, uint8_t* buf);
+
+    /* Read a snapshot from buf of size bytes. Returns false, and leaves
+     * blocks alone, if there is no valid one. */
+    static bool decode(
+        const uint8_t* buf, size_t size, uint32_t& seq,
+        std::vector<Block>& blocks);
+
+private:
+    static constexpr uint32_t MAGIC = 0x31706e73; /* "snp1" */
+
+    static uint32_t checksum(const uint8_t* buf, size_t size);
+};
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_SNAPSHOT_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,193 @@
+/*
+ * render/transition.cpp - part of PIM670 Zabbix Display
+ */
+
+#include <algorithm>
+
+#include "render/transition.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+#endif
+
+namespace render {
+
+void Transition::start(
+    const std::vector<Block>& old_blocks, const Layout& old_layout,
+    const std::vector<Block>& new_blocks, const Layout& new_layout,
+    uint32_t now_us)
+{
+    constexpr int full = palette::FADE_STEPS - 1;
+    /* A layout that was never set has a negative count. */
+    int old_count = std::min<int>(old_blocks.size(), old_layout.count());
+    int new_count = std::min<int>(new_blocks.size(), new_layout.count());
+    old_count = std::max(old_count, 0);
+    new_count = std::max(new_count, 0);
+
+    /* Match old blocks to new ones by id; the first unmatched one wins
+     * when ids repeat. */
+    std::vector<int> match(old_count, -1);
+    std::vector<bool> taken(new_count, false);
+    for (int i = 0; i < old_count; ++i)
+    {
+        for (int j = 0; j < new_count; ++j)
+        {
+            if (!taken[j] && new_blocks[j].id == old_blocks[i].id)
+            {
+                match[i] = j;
+                taken[j] = true;
+                break;
+            }
+        }
+    }
+
+    m_keyframes.clear();
+    /* Gone ones first, so whatever slides in is drawn over them. */
+    for (int i = 0; i < old_count; ++i)
+    {
+        if (match[i] < 0)
+        {
+            uint8_t suppressed = old_blocks[i].suppressed;
+            m_keyframes.push_back(Keyframe{
+                old_layout[i], old_layout[i], suppressed, suppressed, full,
+                0});
+        }
+    }
+    for (int i = 0; i < old_count; ++i)
+    {
+        if (match[i] >= 0)
+        {
+            int j = match[i];
+            m_keyframes.push_back(Keyframe{
+                old_layout[i], new_layout[j], old_blocks[i].suppressed,
+                new_blocks[j].suppressed, full, full});
+        }
+    }
+    for (int j = 0; j < new_count; ++j)
+    {
+        if (!taken[j])
+        {
+            uint8_t suppressed = new_blocks[j].suppressed;
+            m_keyframes.push_back(Keyframe{
+                new_layout[j], new_layout[j], suppressed, suppressed, 0,
+                full});
+        }
+    }
+
+    m_start_us = now_us;
+    m_active = true;
+}
+
+int Transition::progress(uint32_t now_us) const
+{
+    uint32_t elapsed = now_us - m_start_us;
+    if (!m_active || elapsed >= DURATION_US)
+    {
+        return PROGRESS_ONE;
+    }
+    /* Smoothstep: slow start, slow end. */
+    int t = elapsed * PROGRESS_ONE / DURATION_US;
+    return t * t * (3 * PROGRESS_ONE - 2 * t)
+           / (PROGRESS_ONE * PROGRESS_ONE);
+}
+
+} // namespace render
+
+#ifdef RUNTESTS
+using namespace render;
+
+static bool same(const BlockRect& a, const BlockRect& b)
+{
+    return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+int main()
+{
+    static Layout old_layout;
+    static Layout new_layout;
+    static Transition transition;
+    int errors = 0;
+
+    /* A goes, B and C stay (C gets suppressed), D and E arrive. */
+    std::vector<Block> old_blocks = {{1, false}, {2, false}, {3, false}};
+    std::vector<Block> new_blocks = {
+        {2, false}, {3, true}, {4, false}, {5, false}, {5, false}};
+    old_layout.set_count(old_blocks.size());
+    new_layout.set_count(new_blocks.size());
+    transition.start(old_blocks, old_layout, new_blocks, new_layout, 1000);
+
+    const std::vector<Keyframe>& keys = transition.keyframes();
+    if (keys.size() != 6)
+    {
+        printf("transition: %zu keyframes, want 6\n", keys.size());
+        return 1;
+    }
+    /* A fades out where it was. */
+    if (!same(keys[0].from, old_layout[0]) || keys[0].to_step != 0)
+    {
+        printf("transition: gone block does not fade out\n");
+        ++errors;
+    }
+    /* B and C slide to their new places; C turns gray. */
+    if (!same(keys[1].from, old_layout[1]) || !same(keys[1].to, new_layout[0])
+        || !same(keys[2].from, old_layout[2])
+        || !same(keys[2].to, new_layout[1]) || !keys[2].to_suppressed)
+    {
+        printf("transition: kept blocks do not slide\n");
+        ++errors;
+    }
+    /* D and both Es fade in at their new places. */
+    for (int k = 3; k < 6; ++k)
+    {
+        if (!same(keys[k].to, new_layout[k - 1]) || keys[k].from_step != 0)
+        {
+            printf("transition: new block %d does not fade in\n", k - 1);
+            ++errors;
+        }
+    }
+
+    /* Progress is eased, monotonic and reaches the end. */
+    int last = -1;
+    for (uint32_t us = 0; us <= Transition::DURATION_US; us += 1000)
+    {
+        int progress = transition.progress(1000 + us);
+        if (progress < last)
+        {
+            printf("transition: progress goes back at %u us\n", us);
+            ++errors;
+            break;
+        }
+        last = progress;
+    }
+    if (transition.progress(1000) != 0 || last != Transition::PROGRESS_ONE)
+    {
+        printf("transition: progress does not run 0 .. %d\n", last);
+        ++errors;
+    }
+
+    /* At the end, everything that is drawn is where the layout says. */
+    int drawn = 0;
+    transition.draw(
+        Transition::PROGRESS_ONE,
+        [&](const BlockRect& rect, int suppressed, int step) {
+            if (!same(rect, new_layout[drawn])
+                || suppressed != new_blocks[drawn].suppressed
+                || step != palette::FADE_STEPS - 1)
+            {
+                printf("transition: block %d ends up wrong\n", drawn);
+                ++errors;
+            }
+            ++drawn;
+        });
+    if (drawn != 5)
+    {
+        printf("transition: %d blocks drawn at the end, want 5\n", drawn);
+        ++errors;
+    }
+
+    printf("transition: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
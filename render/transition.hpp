@@ -0,0 +1,99 @@
+/*
+ * render/transition.hpp - part of PIM670 Zabbix Display
+ *
+ * Animates the alert blocks from one set of alerts to the next: blocks of
+ * alerts that stay slide (and resize) to their new place, new ones fade in
+ * and gone ones fade out. The keyframes are computed once, from a diff of
+ * the two sets by alert id; every frame only interpolates them.
+ */
+#ifndef INCLUDED_RENDER_TRANSITION_HPP
+#define INCLUDED_RENDER_TRANSITION_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "render/layout.hpp"
+#include "render/palette.hpp"
+
+namespace render {
+
+/* One block's way through the transition. Steps index the alert fade
+ * ramps; step 0 is not drawn at all. */
+struct Keyframe
+{
+    BlockRect from;
+    BlockRect to;
+    uint8_t from_suppressed;
+    uint8_t to_suppressed;
+    uint8_t from_step;
+    uint8_t to_step;
+};
+
+class Transition
+{
+public:
+    static constexpr uint32_t DURATION_US = 600000;
+    static constexpr int PROGRESS_ONE = 256;
+
+    /* Compute the keyframes from the blocks on display to the new ones. */
+    void start(
+        const std::vector<Block>& old_blocks, const Layout& old_layout,
+        const std::vector<Block>& new_blocks, const Layout& new_layout,
+        uint32_t now_us);
+
+    bool active() const
+    {
+        return m_active;
+    }
+    void finish()
+    {
+        m_active = false;
+    }
+
+    /* Eased progress, 0 .. PROGRESS_ONE; done at PROGRESS_ONE. */
+    int progress(uint32_t now_us) const;
+
+    const std::vector<Keyframe>& keyframes() const
+    {
+        return m_keyframes;
+    }
+
+    /* Call draw(rect, suppressed, step) for every visible block. */
+    template <typename Draw>
+    void draw(int progress, Draw draw) const
+    {
+        for (const Keyframe& key : m_keyframes)
+        {
+            BlockRect rect = {
+                lerp(key.from.x, key.to.x, progress),
+                lerp(key.from.y, key.to.y, progress),
+                lerp(key.from.w, key.to.w, progress),
+                lerp(key.from.h, key.to.h, progress)};
+            int step = lerp(key.from_step, key.to_step, progress);
+            /* Suppression toggles halfway; there is no gray-red ramp. */
+            int suppressed = (progress < PROGRESS_ONE / 2)
+                                 ? key.from_suppressed
+                                 : key.to_suppressed;
+            if (step > 0 && rect.w > 0 && rect.h > 0)
+            {
+                draw(rect, suppressed, step);
+            }
+        }
+    }
+
+private:
+    static int8_t lerp(int from, int to, int progress)
+    {
+        return from + (to - from) * progress / PROGRESS_ONE;
+    }
+
+    std::vector<Keyframe> m_keyframes;
+    uint32_t m_start_us = 0;
+    bool m_active = false;
+};
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_TRANSITION_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,77 @@
+/*
+ * render/triplebuffer.cpp - part of PIM670 Zabbix Display
+ *
+ * The triple buffer lives in render/triplebuffer.hpp; this holds its test:
+ * two threads standing in for the two cores.
+ */
+#include "render/triplebuffer.hpp"
+
+#ifdef RUNTESTS
+# include <cstdint>
+# include <cstdio>
+# include <thread>
+#endif
+
+#ifdef RUNTESTS
+using namespace render;
+
+/* Large enough that a torn copy is likely to show. */
+struct State
+{
+    uint32_t seq;
+    uint32_t values[255];
+};
+
+int main()
+{
+    static TripleBuffer<State> buffer;
+    constexpr uint32_t publishes = 2000000;
+    std::atomic<bool> done{false};
+
+    std::thread producer([&]() {
+        for (uint32_t seq = 1; seq <= publishes; ++seq)
+        {
+            State& state = buffer.write_buffer();
+            state.seq = seq;
+            for (uint32_t& value : state.values)
+            {
+                value = seq;
+            }
+            buffer.publish();
+        }
+        done = true;
+    });
+
+    int torn = 0;
+    int backwards = 0;
+    uint32_t reads = 0;
+    uint32_t last_seq = 0;
+    while (!done || last_seq != publishes)
+    {
+        const State& state = buffer.read();
+        uint32_t seq = state.seq;
+        for (uint32_t value : state.values)
+        {
+            if (value != seq)
+            {
+                ++torn;
+                break;
+            }
+        }
+        if (seq < last_seq)
+        {
+            ++backwards;
+        }
+        last_seq = seq;
+        ++reads;
+    }
+    producer.join();
+
+    printf(
+        "triplebuffer: %u reads of %u publishes, %d torn, %d out of order\n",
+        reads, publishes, torn, backwards);
+    return (torn || backwards) ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
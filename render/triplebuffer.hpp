@@ -0,0 +1,76 @@
+/*
+ * render/triplebuffer.hpp - part of PIM670 Zabbix Display
+ *
+ * Hands the latest copy of some state from one core (the producer) to the
+ * other (the consumer) without either of them ever waiting:
+ *
+ * - the producer fills write_buffer() and publish()es it;
+ * - the consumer read()s the latest published buffer, which stays put
+ *   until its next read().
+ *
+ * With three buffers there is always one that is neither the latest nor
+ * being read, so the producer always has a place to write. The swap uses
+ * plain atomic loads and stores only: the Cortex-M0+ has no LDREX/STREX, so
+ * a compare-exchange would need a lock. Instead, the consumer announces
+ * what it is about to read and checks that it is still the latest.
+ */
+#ifndef INCLUDED_RENDER_TRIPLEBUFFER_HPP
+#define INCLUDED_RENDER_TRIPLEBUFFER_HPP
+
+#include <atomic>
+
+namespace render {
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    /* Producer: the buffer to fill. Holds whatever was in it before, which
+     * is not necessarily the previous publish(). */
+    T& write_buffer()
+    {
+        return m_buffers[m_writing];
+    }
+
+    /* Producer: make the write_buffer() the latest; pick a new one. */
+    void publish()
+    {
+        m_latest.store(m_writing);
+        int reading = m_reading.load();
+        for (int i = 0; i < 3; ++i)
+        {
+            if (i != m_writing && i != reading)
+            {
+                m_writing = i;
+                break;
+            }
+        }
+    }
+
+    /* Consumer: the latest published buffer. If the producer publishes
+     * between the announce and the check, the announced buffer may be the
+     * one the producer picks next, so we try again. */
+    const T& read()
+    {
+        int latest;
+        do
+        {
+            latest = m_latest.load();
+            m_reading.store(latest);
+        } while (m_latest.load() != latest);
+        return m_buffers[latest];
+    }
+
+private:
+    T m_buffers[3];
+    /* Producer only. */
+    int m_writing = 1;
+    std::atomic<int> m_latest{0};
+    std::atomic<int> m_reading{0};
+};
+
+} // namespace render
+
+#endif // INCLUDED_RENDER_TRIPLEBUFFER_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,174 @@
+/*
+ * sched/governor.cpp - part of PIM670 Zabbix Display
+ */
+
+#include <algorithm>
+
+#include "sched/governor.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+# include <vector>
+#endif
+
+namespace sched {
+
+Governor::Governor(Clock clock_us, SetLevel set_level, int priority)
+    : Task("clock", priority), m_clock_us(clock_us), m_set_level(set_level)
+{
+    for (std::atomic<uint8_t>& demand : m_demands)
+    {
+        demand.store(LOW, std::memory_order_relaxed);
+    }
+    m_wanted_us = m_since_us = m_clock_us();
+}
+
+void Governor::set_enabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+void Governor::update()
+{
+    uint32_t now_us = m_clock_us();
+    m_level_us[m_level].add(now_us - m_since_us);
+    m_since_us = now_us;
+
+    int want = NORMAL;
+    if (m_enabled)
+    {
+        want = LOW;
+        for (const std::atomic<uint8_t>& demand : m_demands)
+        {
+            want = std::max<int>(want, demand.load(std::memory_order_relaxed));
+        }
+    }
+    if (want >= m_level)
+    {
+        m_wanted_us = now_us;
+    }
+    if (want == m_level
+        || (want < m_level && now_us - m_wanted_us < HOLD_US))
+    {
+        return;
+    }
+    if (m_set_level(static_cast<Level>(want)))
+    {
+        m_level = static_cast<Level>(want);
+        m_wanted_us = now_us;
+        m_switches.add(1);
+    }
+}
+
+} // namespace sched
+
+#ifdef RUNTESTS
+using namespace sched;
+
+static uint32_t fake_now_us;
+static uint32_t fake_clock_us()
+{
+    return fake_now_us;
+}
+
+static std::vector<int> fake_levels;
+static bool fake_broken;
+static bool fake_set_level(Governor::Level level)
+{
+    if (fake_broken)
+    {
+        return false;
+    }
+    fake_levels.push_back(level);
+    return true;
+}
+
+int main()
+{
+    int errors = 0;
+    fake_now_us = 1000;
+    Governor governor(fake_clock_us, fake_set_level, 0);
+
+    /* Nothing to do: down to LOW, but only after the hold time. */
+    governor.update();
+    fake_now_us += Governor::HOLD_US - 1;
+    governor.update();
+    if (governor.level() != Governor::NORMAL || !fake_levels.empty())
+    {
+        printf("governor: lowered before the hold time\n");
+        ++errors;
+    }
+    fake_now_us += 1;
+    governor.update();
+    if (governor.level() != Governor::LOW)
+    {
+        printf("governor: not lowered after the hold time\n");
+        ++errors;
+    }
+
+    /* A TLS handshake: up at once. The render demand keeps it at
+     * NORMAL after. */
+    governor.demand(Governor::RENDER, Governor::NORMAL);
+    governor.demand(Governor::FETCH, Governor::HIGH);
+    governor.update();
+    fake_now_us += 300000;
+    governor.update();
+    governor.demand(Governor::FETCH, Governor::LOW);
+    for (int i = 0; i < 30; ++i)
+    {
+        fake_now_us += Governor::UPDATE_US;
+        governor.run(fake_now_us);
+    }
+    if (fake_levels != std::vector<int>{Governor::LOW, Governor::HIGH,
+                                        Governor::NORMAL})
+    {
+        printf("governor: wrong level changes\n");
+        ++errors;
+    }
+
+    /* A failing switch stays where it is. */
+    fake_broken = true;
+    governor.demand(Governor::FETCH, Governor::HIGH);
+    governor.update();
+    fake_broken = false;
+    if (governor.level() != Governor::NORMAL || governor.switches() != 3)
+    {
+        printf("governor: failed switch counted\n");
+        ++errors;
+    }
+
+    /* Disabled: back to NORMAL, whatever the demands. */
+    governor.demand(Governor::FETCH, Governor::LOW);
+    governor.demand(Governor::RENDER, Governor::LOW);
+    governor.set_enabled(false);
+    fake_now_us += 2 * Governor::HOLD_US;
+    governor.update();
+    if (governor.level() != Governor::NORMAL)
+    {
+        printf("governor: disabled, but not at NORMAL\n");
+        ++errors;
+    }
+
+    /* All time is accounted for; HIGH lasted the handshake and the hold
+     * time. */
+    uint32_t total = 0;
+    for (int level = 0; level < Governor::LEVELS; ++level)
+    {
+        total += governor.level_us(static_cast<Governor::Level>(level));
+    }
+    uint32_t high = 300000 + Governor::HOLD_US;
+    if (total != fake_now_us - 1000
+        || governor.level_us(Governor::HIGH) != high)
+    {
+        printf(
+            "governor: %u us accounted, %u at HIGH; want %u, %u\n", total,
+            governor.level_us(Governor::HIGH), fake_now_us - 1000, high);
+        ++errors;
+    }
+
+    printf("governor: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,99 @@
+/*
+ * sched/governor.hpp - part of PIM670 Zabbix Display
+ *
+ * Picks the system clock from what the firmware is doing. Work that wants
+ * a faster clock demands a level; the highest demand wins. Going up takes
+ * effect at the next update(), going down only after the demand stayed
+ * lower for HOLD_US, so a burst of work does not switch back and forth.
+ *
+ * The governor only decides; set_level() does the switching (PLL, core
+ * voltage, PIO dividers). Demands may come from either core, updates and
+ * set_level() run on one core only. Time spent at each level is counted.
+ */
+#ifndef INCLUDED_SCHED_GOVERNOR_HPP
+#define INCLUDED_SCHED_GOVERNOR_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include "sched/scheduler.hpp"
+
+namespace sched {
+
+class Governor : public Task
+{
+public:
+    typedef enum Levels
+    {
+        LOW = 0,
+        NORMAL,
+        HIGH,
+        LEVELS
+    } Level;
+
+    /* Who demands a level; each has its own demand. */
+    typedef enum Sources
+    {
+        FETCH = 0,
+        RENDER,
+        SOURCES
+    } Source;
+
+    /* Switch the clock; returns false if it could not. */
+    typedef bool (*SetLevel)(Level level);
+
+    static constexpr uint32_t HOLD_US = 1000000;
+    /* How often the task looks at the demands. */
+    static constexpr uint32_t UPDATE_US = 50000;
+
+    /* Starts at NORMAL, which must be the clock at boot. As a task, it
+     * is called "clock". */
+    Governor(Clock clock_us, SetLevel set_level, int priority);
+
+    /* Off: stay at NORMAL, whatever the demands. */
+    void set_enabled(bool enabled);
+    void demand(Source source, Level level)
+    {
+        m_demands[source].store(level, std::memory_order_relaxed);
+    }
+
+    /* Apply the demands now. */
+    void update();
+    uint32_t run(uint32_t) override
+    {
+        update();
+        return UPDATE_US;
+    }
+
+    Level level() const
+    {
+        return m_level;
+    }
+    /* Time at level, up to the last update(); wraps like all counters. */
+    uint32_t level_us(Level level) const
+    {
+        return m_level_us[level].get();
+    }
+    uint32_t switches() const
+    {
+        return m_switches.get();
+    }
+
+private:
+    Clock m_clock_us;
+    SetLevel m_set_level;
+    bool m_enabled = true;
+    std::atomic<uint8_t> m_demands[SOURCES];
+    Level m_level = NORMAL;
+    /* When the demand was last at or above the current level. */
+    uint32_t m_wanted_us;
+    uint32_t m_since_us;
+    Counter m_level_us[LEVELS];
+    Counter m_switches;
+};
+
+} // namespace sched
+
+#endif // INCLUDED_SCHED_GOVERNOR_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
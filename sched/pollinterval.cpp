@@ -0,0 +1,225 @@
+/*
+ * sched/pollinterval.cpp - part of PIM670 Zabbix Display
+ */
+
+#include <algorithm>
+
+#include "sched/pollinterval.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+#endif
+
+namespace sched {
+
+void PollInterval::set_bounds(const Bounds& bounds)
+{
+    m_bounds = bounds;
+    m_bounds.max_interval =
+        std::clamp(m_bounds.max_interval, MIN_INTERVAL, MAX_INTERVAL);
+    m_bounds.interval =
+        std::clamp(m_bounds.interval, MIN_INTERVAL, m_bounds.max_interval);
+    m_bounds.fast_interval =
+        std::clamp(m_bounds.fast_interval, MIN_INTERVAL, m_bounds.interval);
+    m_bounds.jitter_percent =
+        std::min(m_bounds.jitter_percent, MAX_JITTER_PERCENT);
+}
+
+uint32_t PollInterval::next(Result result, uint32_t now_ms)
+{
+    if (!m_started)
+    {
+        m_last_change_ms = now_ms;
+        m_started = true;
+    }
+
+    if (result == FAILED)
+    {
+        /* The first failure waits the normal interval. */
+        ++m_failures;
+        m_interval = (m_failures == 1) ? m_bounds.interval
+                                       : doubled(m_interval);
+        return jitter(m_interval);
+    }
+
+    m_failures = 0;
+    if (result == CHANGED)
+    {
+        m_last_change_ms = now_ms;
+        m_changed = true;
+    }
+    uint32_t quiet_ms = now_ms - m_last_change_ms;
+    if (m_changed && quiet_ms < m_bounds.fast_period)
+    {
+        m_interval = m_bounds.fast_interval;
+    }
+    else if (quiet_ms < m_bounds.quiet_period)
+    {
+        m_interval = m_bounds.interval;
+    }
+    else
+    {
+        m_interval = doubled(std::max(m_interval, m_bounds.interval));
+    }
+    return jitter(m_interval);
+}
+
+uint32_t PollInterval::doubled(uint32_t interval) const
+{
+    return (interval > m_bounds.max_interval / 2) ? m_bounds.max_interval
+                                                   : interval * 2;
+}
+
+uint32_t PollInterval::jitter(uint32_t interval)
+{
+    /* Xorshift; good enough to spread the polls. */
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    uint32_t spread = interval / 100 * m_bounds.jitter_percent;
+    return interval - spread + m_random % (2 * spread + 1);
+}
+
+} // namespace sched
+
+#ifdef RUNTESTS
+using namespace sched;
+
+int main()
+{
+    int errors = 0;
+    PollInterval poll;
+    PollInterval::Bounds bounds;
+    bounds.jitter_percent = 0;
+    poll.set_bounds(bounds);
+
+    /* Quiet at first: the normal interval, then backing off to the cap. */
+    uint32_t now = 5000;
+    uint32_t wait = poll.next(PollInterval::UNCHANGED, now);
+    while (now < 5000 + bounds.quiet_period)
+    {
+        if (wait != bounds.interval)
+        {
+            printf(
+                "pollinterval: quiet %u ms, want %u\n", wait, bounds.interval);
+            ++errors;
+            break;
+        }
+        now += wait;
+        wait = poll.next(PollInterval::UNCHANGED, now);
+    }
+    for (uint32_t want : {20000, 40000, 80000, 120000, 120000})
+    {
+        if (wait != want)
+        {
+            printf("pollinterval: backing off %u ms, want %u\n", wait, want);
+            ++errors;
+        }
+        now += wait;
+        wait = poll.next(PollInterval::UNCHANGED, now);
+    }
+
+    /* A change: fast for the fast period, then normal. */
+    wait = poll.next(PollInterval::CHANGED, now);
+    uint32_t changed = now;
+    while (now - changed < bounds.fast_period)
+    {
+        if (wait != bounds.fast_interval)
+        {
+            printf(
+                "pollinterval: after change %u ms, want %u\n", wait,
+                bounds.fast_interval);
+            ++errors;
+            break;
+        }
+        now += wait;
+        wait = poll.next(PollInterval::UNCHANGED, now);
+    }
+    if (wait != bounds.interval)
+    {
+        printf(
+            "pollinterval: after fast period %u ms, want %u\n", wait,
+            bounds.interval);
+        ++errors;
+    }
+
+    /* Failures back off from the normal interval; success resets. */
+    for (uint32_t want : {10000, 20000, 40000, 80000, 120000, 120000})
+    {
+        wait = poll.next(PollInterval::FAILED, now += 1000);
+        if (wait != want)
+        {
+            printf("pollinterval: failing %u ms, want %u\n", wait, want);
+            ++errors;
+        }
+    }
+    if (poll.failures() != 6
+        || poll.next(PollInterval::UNCHANGED, now) != bounds.interval)
+    {
+        printf("pollinterval: success does not reset the backoff\n");
+        ++errors;
+    }
+
+    /* Jitter stays within bounds and does spread. */
+    bounds.jitter_percent = 10;
+    poll.set_bounds(bounds);
+    poll.seed(670);
+    uint32_t lo = ~0u, hi = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        wait = poll.next(PollInterval::UNCHANGED, now);
+        lo = std::min(lo, wait);
+        hi = std::max(hi, wait);
+    }
+    if (lo < 9000 || hi > 11000 || hi - lo < 1500)
+    {
+        printf(
+            "pollinterval: jitter %u .. %u ms, want 9000 .. 11000\n", lo, hi);
+        ++errors;
+    }
+
+    /* Nonsense bounds are made sane. */
+    bounds.fast_interval = 0;
+    bounds.interval = 500;
+    bounds.max_interval = 0;
+    bounds.jitter_percent = 200;
+    poll.set_bounds(bounds);
+    const PollInterval::Bounds& sane = poll.bounds();
+    bool clamped = sane.fast_interval == PollInterval::MIN_INTERVAL
+                   && sane.interval == PollInterval::MIN_INTERVAL
+                   && sane.max_interval == PollInterval::MIN_INTERVAL
+                   && sane.jitter_percent == PollInterval::MAX_JITTER_PERCENT;
+    bounds.fast_interval = 5000;
+    bounds.max_interval = ~0u;
+    poll.set_bounds(bounds);
+    if (!clamped || sane.fast_interval != sane.interval
+        || sane.max_interval != PollInterval::MAX_INTERVAL)
+    {
+        printf("pollinterval: bounds not clamped\n");
+        ++errors;
+    }
+
+    /* At the very top, the jittered wait is still a deadline ahead. */
+    bounds.interval = ~0u;
+    bounds.max_interval = ~0u;
+    bounds.jitter_percent = ~0u;
+    poll.set_bounds(bounds);
+    poll.seed(670);
+    hi = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        hi = std::max(hi, poll.next(PollInterval::FAILED, now += 1000));
+    }
+    if (hi > PollInterval::MAX_INTERVAL / 2 * 3
+        || static_cast<int32_t>(hi * 1000) <= 0)
+    {
+        printf("pollinterval: %u ms wraps a 32-bit deadline\n", hi);
+        ++errors;
+    }
+
+    printf("pollinterval: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
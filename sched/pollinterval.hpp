@@ -0,0 +1,101 @@
+/*
+ * sched/pollinterval.hpp - part of PIM670 Zabbix Display
+ *
+ * How long to wait before the next poll, from how the previous ones went:
+ *
+ * - right after the alerts changed, poll fast for a while: more changes
+ *   tend to follow during an incident;
+ * - after that, poll at the normal interval;
+ * - when nothing changed for a long time, double the interval every poll;
+ * - on failures, double it every failure.
+ *
+ * Intervals are capped and get some random jitter, so a rack of displays
+ * does not end up polling in lockstep.
+ */
+#ifndef INCLUDED_SCHED_POLLINTERVAL_HPP
+#define INCLUDED_SCHED_POLLINTERVAL_HPP
+
+#include <cstdint>
+
+namespace sched {
+
+class PollInterval
+{
+public:
+    /* Never poll faster than this, whatever the config says. */
+    static constexpr uint32_t MIN_INTERVAL = 1000;
+    /* Nor slower than this: the scheduler's deadlines are signed 32-bit
+     * microseconds, and must stay ahead even with the most jitter. */
+    static constexpr uint32_t MAX_INTERVAL = 1200000;
+    static constexpr uint32_t MAX_JITTER_PERCENT = 50;
+    static_assert(
+        static_cast<uint64_t>(MAX_INTERVAL) * (100 + MAX_JITTER_PERCENT) / 100
+                * 1000
+            < (1ull << 31),
+        "a jittered MAX_INTERVAL must fit a 32-bit deadline");
+
+    /* All in milliseconds, except jitter_percent. */
+    struct Bounds
+    {
+        uint32_t interval = 10000;
+        uint32_t fast_interval = 2000;
+        /* Poll fast for this long after a change. */
+        uint32_t fast_period = 120000;
+        /* Start backing off after this long without a change. */
+        uint32_t quiet_period = 600000;
+        uint32_t max_interval = 120000;
+        uint32_t jitter_percent = 10;
+    };
+
+    typedef enum Results
+    {
+        CHANGED = 0,
+        UNCHANGED,
+        FAILED
+    } Result;
+
+    /* Bounds are clamped to MIN_INTERVAL <= fast <= normal <= max <=
+     * MAX_INTERVAL and to MAX_JITTER_PERCENT. */
+    void set_bounds(const Bounds& bounds);
+    const Bounds& bounds() const
+    {
+        return m_bounds;
+    }
+    void seed(uint32_t seed)
+    {
+        m_random = seed ? seed : 1;
+    }
+
+    /* The poll at now_ms ended with result; returns the time until the
+     * next one. */
+    uint32_t next(Result result, uint32_t now_ms);
+
+    /* The interval next() picked last, before jitter. */
+    uint32_t interval() const
+    {
+        return m_interval;
+    }
+    uint32_t failures() const
+    {
+        return m_failures;
+    }
+
+private:
+    uint32_t doubled(uint32_t interval) const;
+    uint32_t jitter(uint32_t interval);
+
+    Bounds m_bounds;
+    uint32_t m_interval = m_bounds.interval;
+    uint32_t m_failures = 0;
+    /* Quiet since the first poll, but only poll fast after a change. */
+    bool m_started = false;
+    bool m_changed = false;
+    uint32_t m_last_change_ms = 0;
+    uint32_t m_random = 1;
+};
+
+} // namespace sched
+
+#endif // INCLUDED_SCHED_POLLINTERVAL_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,230 @@
+/*
+ * sched/scheduler.cpp - part of PIM670 Zabbix Display
+ */
+
+#include "opt/placement.h"
+#include "sched/scheduler.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+# include <string>
+#endif
+
+namespace sched {
+
+void Scheduler::add(Task& task)
+{
+    auto pos = m_tasks.begin();
+    while (pos != m_tasks.end() && (*pos)->priority() >= task.priority())
+    {
+        ++pos;
+    }
+    task.m_next_us = m_clock_us();
+    m_tasks.insert(pos, &task);
+}
+
+HOT_PATH("sched") uint32_t Scheduler::run_once()
+{
+    uint32_t pass_us = m_clock_us();
+    for (Task* task : m_tasks)
+    {
+        if (static_cast<int32_t>(task->m_next_us - pass_us) > 0
+            && !task->m_woken && !task->ready())
+        {
+            continue;
+        }
+        task->m_woken = false;
+        uint32_t hits = 0;
+        uint32_t accesses = 0;
+        if (m_cache_probe)
+        {
+            m_cache_probe(hits, accesses);
+        }
+        uint32_t start = m_clock_us();
+        uint32_t delay = task->run(start);
+        uint32_t took = m_clock_us() - start;
+        task->m_next_us = start + delay;
+        task->m_runs.add(1);
+        task->m_run_us.add(took);
+        task->m_max_us.raise(took);
+        if (m_cache_probe)
+        {
+            uint32_t hits_after;
+            uint32_t accesses_after;
+            m_cache_probe(hits_after, accesses_after);
+            if (hits_after >= hits && accesses_after >= accesses)
+            {
+                task->m_cache_hits.add(hits_after - hits);
+                task->m_cache_accesses.add(accesses_after - accesses);
+            }
+        }
+    }
+
+    uint32_t now = m_clock_us();
+    uint32_t wait = MAX_IDLE_US;
+    for (const Task* task : m_tasks)
+    {
+        int32_t left = task->m_next_us - now;
+        if (left <= 0 || task->m_woken || task->ready())
+        {
+            return 0;
+        }
+        if (static_cast<uint32_t>(left) < wait)
+        {
+            wait = left;
+        }
+    }
+    return wait;
+}
+
+} // namespace sched
+
+#ifdef RUNTESTS
+using namespace sched;
+
+static uint32_t fake_now_us;
+static uint32_t fake_clock_us()
+{
+    return fake_now_us;
+}
+
+/* A cache that hits 3 out of 4 accesses, one access per microsecond;
+ * the counters are cleared at fake_clear_us. */
+static uint32_t fake_clear_us = UINT32_MAX;
+static uint32_t fake_cleared_us;
+static void fake_cache_probe(uint32_t& hits, uint32_t& accesses)
+{
+    if (fake_now_us >= fake_clear_us)
+    {
+        fake_cleared_us = fake_clear_us;
+        fake_clear_us = UINT32_MAX;
+    }
+    uint32_t counted_us = fake_now_us - fake_cleared_us;
+    hits = counted_us / 4 * 3;
+    accesses = counted_us / 4 * 4;
+}
+
+/* Takes cost_us per step and wants to run every period_us. */
+class FakeTask : public Task
+{
+public:
+    FakeTask(
+        const char* name, int priority, uint32_t period_us, uint32_t cost_us,
+        std::string& trace)
+        : Task(name, priority), m_period_us(period_us), m_cost_us(cost_us),
+          m_trace(trace)
+    {
+    }
+
+    uint32_t run(uint32_t now_us) override
+    {
+        fake_now_us = now_us + m_cost_us;
+        m_trace += name();
+        m_pending = false;
+        return m_period_us;
+    }
+    bool ready() const override
+    {
+        return m_pending;
+    }
+    void post()
+    {
+        m_pending = true;
+    }
+
+private:
+    uint32_t m_period_us;
+    uint32_t m_cost_us;
+    std::string& m_trace;
+    bool m_pending = false;
+};
+
+int main()
+{
+    int errors = 0;
+    std::string trace;
+    Scheduler scheduler(fake_clock_us);
+    FakeTask low("l", 0, 0, 100, trace);
+    FakeTask frame("f", 2, 10000, 3000, trace);
+    FakeTask event("e", 1, 1000000, 10, trace);
+    scheduler.add(low);
+    scheduler.add(frame);
+    scheduler.add(event);
+
+    /* All due at first: by priority. */
+    if (scheduler.run_once() != 0 || trace != "fel")
+    {
+        printf("sched: first pass ran \"%s\", want \"fel\"\n", trace.c_str());
+        ++errors;
+    }
+
+    /* A task that is always due does not starve the others; an event
+     * or a wake() runs its task before the deadline. */
+    trace.clear();
+    event.post();
+    scheduler.run_once();
+    scheduler.run_once();
+    frame.wake();
+    scheduler.run_once();
+    if (trace != "ellfl")
+    {
+        printf("sched: passes ran \"%s\", want \"ellfl\"\n", trace.c_str());
+        ++errors;
+    }
+
+    /* Without the busy task, the scheduler idles until the next frame. */
+    Scheduler idler(fake_clock_us);
+    FakeTask frame2("f", 0, 10000, 3000, trace);
+    fake_now_us = 5;
+    idler.add(frame2);
+    uint32_t idled_us = 0;
+    idler.run_for(1000000, [&](uint32_t us) {
+        idled_us += us;
+        fake_now_us += us;
+    });
+    if (frame2.runs() != 100 || frame2.run_us() != 300000
+        || frame2.max_us() != 3000)
+    {
+        printf(
+            "sched: %u runs, %u us, max %u us; want 100, 300000, 3000\n",
+            frame2.runs(), frame2.run_us(), frame2.max_us());
+        ++errors;
+    }
+    if (idler.idle_us() != idled_us || idled_us != 700000)
+    {
+        printf(
+            "sched: idled %u us, counted %u us; want 700000\n", idled_us,
+            idler.idle_us());
+        ++errors;
+    }
+
+    /* The probe counts per task, but not across a clear. */
+    Scheduler probed(fake_clock_us);
+    FakeTask frame3("f", 0, 10000, 4000, trace);
+    probed.set_cache_probe(fake_cache_probe);
+    fake_now_us = 0;
+    probed.add(frame3);
+    for (int i = 0; i < 11; ++i)
+    {
+        if (i == 10)
+        {
+            /* Between the samples around the step. */
+            fake_clear_us = fake_now_us + 1;
+        }
+        probed.run_once();
+        fake_now_us += 6000;
+    }
+    if (frame3.cache_hits() != 30000 || frame3.cache_accesses() != 40000)
+    {
+        printf(
+            "sched: %u cache hits of %u; want 30000 of 40000\n",
+            frame3.cache_hits(), frame3.cache_accesses());
+        ++errors;
+    }
+
+    printf("sched: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
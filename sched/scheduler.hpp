@@ -0,0 +1,222 @@
+/*
+ * sched/scheduler.hpp - part of PIM670 Zabbix Display
+ *
+ * A small cooperative scheduler for stackless tasks. A task is an object
+ * whose run() does one step of work and returns how long until it wants
+ * to run again; state that has to survive between steps lives in its
+ * members (usually a state enum), not on a stack.
+ *
+ * Every pass runs the due tasks in order of priority, each at most once,
+ * so a task that is always due cannot starve the others. Between passes
+ * the scheduler idles until the next deadline, or until a task reports an
+ * event through ready().
+ *
+ * Run time is accounted per task and the idle time per scheduler; with a
+ * cache probe, also the cache hits and accesses during each task. The
+ * counters have a single writer, the core that runs the scheduler, and
+ * can be read from the other core.
+ */
+#ifndef INCLUDED_SCHED_SCHEDULER_HPP
+#define INCLUDED_SCHED_SCHEDULER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace sched {
+
+/* A free running microsecond clock, like time_us_32(). */
+typedef uint32_t (*Clock)();
+
+/* Reads a pair of event counters, like the XIP cache hits and accesses.
+ * They may be cleared now and then: a step during which they went back
+ * is not counted. */
+typedef void (*CacheProbe)(uint32_t& hits, uint32_t& accesses);
+
+/* A wrapping microsecond/event counter, written by one core only. A plain
+ * load and store instead of fetch_add: the RP2040 has no atomic
+ * read-modify-write. */
+class Counter
+{
+public:
+    void add(uint32_t n)
+    {
+        m_value.store(
+            m_value.load(std::memory_order_relaxed) + n,
+            std::memory_order_relaxed);
+    }
+    void raise(uint32_t n)
+    {
+        if (n > m_value.load(std::memory_order_relaxed))
+        {
+            m_value.store(n, std::memory_order_relaxed);
+        }
+    }
+    uint32_t get() const
+    {
+        return m_value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> m_value{0};
+};
+
+class Task
+{
+public:
+    Task(const char* name, int priority) : m_name(name), m_priority(priority)
+    {
+    }
+    virtual ~Task()
+    {
+    }
+
+    /* Do one step of work. Returns the microseconds until the next step,
+     * counted from now_us; 0 runs it again in the next pass. */
+    virtual uint32_t run(uint32_t now_us) = 0;
+    /* An event is waiting, run in the next pass whatever the deadline. */
+    virtual bool ready() const
+    {
+        return false;
+    }
+    /* Run in the next pass, whatever the deadline. Only from the core
+     * that runs the scheduler. */
+    void wake()
+    {
+        m_woken = true;
+    }
+
+    /* Progress, for a Supervisor: all is well until until_us, which is
+     * usually now, or a deadline when the task goes to sleep. Any core. */
+    void beat(uint32_t until_us)
+    {
+        m_beat_us.store(until_us, std::memory_order_relaxed);
+    }
+    uint32_t beat_us() const
+    {
+        return m_beat_us.load(std::memory_order_relaxed);
+    }
+    /* Called by a Supervisor, on its core, when the beats stopped; attempt
+     * counts up from 1 until the task beats again. Returns false if the
+     * task cannot be restarted. */
+    virtual bool restart(int)
+    {
+        return false;
+    }
+
+    const char* name() const
+    {
+        return m_name;
+    }
+    int priority() const
+    {
+        return m_priority;
+    }
+
+    /* Accounting; the microsecond counters wrap every 71 minutes, so
+     * only use differences. */
+    uint32_t runs() const
+    {
+        return m_runs.get();
+    }
+    uint32_t run_us() const
+    {
+        return m_run_us.get();
+    }
+    /* Longest single step. */
+    uint32_t max_us() const
+    {
+        return m_max_us.get();
+    }
+    /* Per the scheduler's cache probe; also wrapping. */
+    uint32_t cache_hits() const
+    {
+        return m_cache_hits.get();
+    }
+    uint32_t cache_accesses() const
+    {
+        return m_cache_accesses.get();
+    }
+
+private:
+    friend class Scheduler;
+
+    const char* m_name;
+    int m_priority;
+    uint32_t m_next_us = 0;
+    bool m_woken = false;
+    std::atomic<uint32_t> m_beat_us{0};
+    Counter m_runs;
+    Counter m_run_us;
+    Counter m_max_us;
+    Counter m_cache_hits;
+    Counter m_cache_accesses;
+};
+
+class Scheduler
+{
+public:
+    /* Idle at most this long at a time, even without any tasks. */
+    static constexpr uint32_t MAX_IDLE_US = 100000;
+
+    explicit Scheduler(Clock clock_us) : m_clock_us(clock_us)
+    {
+    }
+
+    /* Sample the probe around every step; null stops it. */
+    void set_cache_probe(CacheProbe probe)
+    {
+        m_cache_probe = probe;
+    }
+
+    /* Tasks run from the next pass on; a higher priority runs first.
+     * Equal priorities run in the order they were added. */
+    void add(Task& task);
+
+    /* Run every due or ready task once. Returns the microseconds until
+     * the next deadline (at most MAX_IDLE_US), 0 if something is due. */
+    uint32_t run_once();
+
+    /* Run passes until the time runs out; in between, idle(us) waits for
+     * up to us microseconds, or until an interrupt. */
+    template <typename Idle>
+    void run_for(uint32_t duration_us, Idle idle)
+    {
+        uint32_t start = m_clock_us();
+        uint32_t elapsed;
+        while ((elapsed = m_clock_us() - start) < duration_us)
+        {
+            uint32_t wait = run_once();
+            elapsed = m_clock_us() - start;
+            if (wait > 0 && elapsed < duration_us)
+            {
+                uint32_t idle_start = m_clock_us();
+                idle(wait < duration_us - elapsed ? wait
+                                                  : duration_us - elapsed);
+                m_idle_us.add(m_clock_us() - idle_start);
+            }
+        }
+    }
+
+    const std::vector<Task*>& tasks() const
+    {
+        return m_tasks;
+    }
+    /* Time spent in idle(); wraps like the task counters. */
+    uint32_t idle_us() const
+    {
+        return m_idle_us.get();
+    }
+
+private:
+    Clock m_clock_us;
+    CacheProbe m_cache_probe = nullptr;
+    std::vector<Task*> m_tasks;
+    Counter m_idle_us;
+};
+
+} // namespace sched
+
+#endif // INCLUDED_SCHED_SCHEDULER_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
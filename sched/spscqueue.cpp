@@ -0,0 +1,87 @@
+/*
+ * sched/spscqueue.cpp - part of PIM670 Zabbix Display
+ *
+ * The queue is header only; this is its test.
+ */
+
+#include "sched/spscqueue.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+# include <thread>
+#endif
+
+#ifdef RUNTESTS
+using namespace sched;
+
+/* Two words, so a torn item could show. */
+struct Item
+{
+    uint32_t seq;
+    uint32_t check;
+};
+
+int main()
+{
+    static SpscQueue<Item, 16> queue;
+    constexpr uint32_t items = 200000;
+    int errors = 0;
+
+    /* Single threaded: capacity, order and drops. */
+    Item item;
+    for (uint32_t i = 0; i < 20; ++i)
+    {
+        queue.push(Item{i, ~i});
+    }
+    for (uint32_t i = 0; queue.pop(item); ++i)
+    {
+        if (item.seq != i)
+        {
+            printf("spscqueue: got %u, want %u\n", item.seq, i);
+            ++errors;
+        }
+    }
+    if (queue.dropped() != 5 || !queue.empty())
+    {
+        printf("spscqueue: %u dropped, want 5\n", queue.dropped());
+        ++errors;
+    }
+
+    /* Producer and consumer in threads: nothing lost or torn. */
+    std::thread producer([&]() {
+        for (uint32_t seq = 1; seq <= items; ++seq)
+        {
+            while (!queue.push(Item{seq, ~seq}))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t last = 0;
+    int torn = 0;
+    while (last != items)
+    {
+        if (!queue.pop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (item.check != ~item.seq)
+        {
+            ++torn;
+        }
+        if (item.seq != last + 1)
+        {
+            ++errors;
+        }
+        last = item.seq;
+    }
+    producer.join();
+
+    printf(
+        "spscqueue: %u items, %d torn, %d errors\n", items, torn, errors);
+    return (torn || errors) ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,78 @@
+/*
+ * sched/spscqueue.hpp - part of PIM670 Zabbix Display
+ *
+ * A fixed size queue for one producer and one consumer, e.g. an interrupt
+ * handler and a task, without locks or disabling interrupts. Each index
+ * has a single writer, so plain atomic loads and stores do: the Cortex-M0+
+ * has no atomic read-modify-write.
+ *
+ * When the queue is full, push() drops the item and counts it.
+ */
+#ifndef INCLUDED_SCHED_SPSCQUEUE_HPP
+#define INCLUDED_SCHED_SPSCQUEUE_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace sched {
+
+/* Holds up to SIZE - 1 items; SIZE must be a power of two. */
+template <typename T, uint32_t SIZE>
+class SpscQueue
+{
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+public:
+    /* Producer. Returns false if the queue was full. */
+    bool push(const T& item)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        uint32_t next = (head + 1) & (SIZE - 1);
+        if (next == m_tail.load(std::memory_order_acquire))
+        {
+            m_dropped.store(
+                m_dropped.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+            return false;
+        }
+        m_items[head] = item;
+        m_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer. Returns false if the queue was empty. */
+    bool pop(T& item)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = m_items[tail];
+        m_tail.store((tail + 1) & (SIZE - 1), std::memory_order_release);
+        return true;
+    }
+
+    /* Either side; may be out of date by the time it returns. */
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire)
+               == m_tail.load(std::memory_order_acquire);
+    }
+    uint32_t dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    T m_items[SIZE];
+    std::atomic<uint32_t> m_head{0};
+    std::atomic<uint32_t> m_tail{0};
+    std::atomic<uint32_t> m_dropped{0};
+};
+
+} // namespace sched
+
+#endif // INCLUDED_SCHED_SPSCQUEUE_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
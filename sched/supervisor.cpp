@@ -0,0 +1,191 @@
+/*
+ * sched/supervisor.cpp - part of PIM670 Zabbix Display
+ */
+
+#include "sched/supervisor.hpp"
+
+#include <algorithm>
+
+#ifdef RUNTESTS
+# include <cstdio>
+#endif
+
+namespace sched {
+
+bool Supervisor::watch(Task& task, uint32_t timeout_us)
+{
+    if (m_count == MAX_WATCHED)
+    {
+        return false;
+    }
+    Watched& watched = m_watched[m_count++];
+    watched.task = &task;
+    watched.timeout_us = timeout_us;
+    /* The first beat may take as long as any other. */
+    watched.restarted_us = m_clock_us();
+    watched.attempts = 0;
+    return true;
+}
+
+void Supervisor::check()
+{
+    uint32_t now_us = m_clock_us();
+    for (int i = 0; i < m_count; ++i)
+    {
+        Watched& watched = m_watched[i];
+        /* Signed: a beat may lie in the future. */
+        int32_t since_beat = now_us - watched.task->beat_us();
+        int32_t since_restart = now_us - watched.restarted_us;
+        if (since_beat < since_restart)
+        {
+            /* It came back. */
+            watched.attempts = 0;
+        }
+        if (std::min(since_beat, since_restart)
+            < static_cast<int32_t>(watched.timeout_us))
+        {
+            continue;
+        }
+        if (watched.attempts < MAX_RESTARTS
+            && watched.task->restart(watched.attempts + 1))
+        {
+            ++watched.attempts;
+            watched.restarts.add(1);
+            watched.restarted_us = now_us;
+        }
+        else if (m_failed == nullptr)
+        {
+            m_failed = watched.task;
+        }
+    }
+}
+
+} // namespace sched
+
+#ifdef RUNTESTS
+using namespace sched;
+
+static uint32_t fake_now_us;
+static uint32_t fake_clock_us()
+{
+    return fake_now_us;
+}
+
+/* Restarts if it can; remembers the last attempt. */
+class FakeTask : public Task
+{
+public:
+    FakeTask(const char* name, bool restartable)
+        : Task(name, 0), m_restartable(restartable)
+    {
+    }
+
+    uint32_t run(uint32_t) override
+    {
+        return 0;
+    }
+    bool restart(int attempt) override
+    {
+        m_attempt = attempt;
+        return m_restartable;
+    }
+    int attempt() const
+    {
+        return m_attempt;
+    }
+
+private:
+    bool m_restartable;
+    int m_attempt = 0;
+};
+
+int main()
+{
+    int errors = 0;
+    Supervisor supervisor(fake_clock_us, 0);
+    FakeTask fetch("fetch", true);
+    FakeTask render("render", false);
+    fake_now_us = 1000;
+    supervisor.watch(fetch, 10000);
+    supervisor.watch(render, 20000);
+
+    /* Beats, also ones in the future, keep the restarts away. */
+    for (int i = 0; i < 100; ++i)
+    {
+        fake_now_us += 5000;
+        fetch.beat(fake_now_us);
+        render.beat((i == 50) ? fake_now_us + 200000 : fake_now_us);
+        supervisor.check();
+    }
+    if (fetch.attempt() || render.attempt() || !supervisor.healthy())
+    {
+        printf("supervisor: restarted a task that beats\n");
+        ++errors;
+    }
+
+    /* No beats: restart, each attempt a timeout after the last. */
+    for (int attempt = 1; attempt <= 2; ++attempt)
+    {
+        fake_now_us += 9000;
+        supervisor.check();
+        render.beat(fake_now_us);
+        fake_now_us += 2000;
+        supervisor.check();
+        render.beat(fake_now_us);
+        if (fetch.attempt() != attempt
+            || supervisor.restarts(0) != static_cast<uint32_t>(attempt))
+        {
+            printf(
+                "supervisor: attempt %d, %u restarts; want %d\n",
+                fetch.attempt(), supervisor.restarts(0), attempt);
+            ++errors;
+        }
+    }
+
+    /* A beat resets the attempts, not the counter. */
+    fetch.beat(fake_now_us + 1);
+    fake_now_us += 5000;
+    supervisor.check();
+    render.beat(fake_now_us);
+    for (int i = 0; i < Supervisor::MAX_RESTARTS; ++i)
+    {
+        fake_now_us += 10000;
+        supervisor.check();
+        render.beat(fake_now_us);
+    }
+    if (fetch.attempt() != Supervisor::MAX_RESTARTS
+        || supervisor.restarts(0) != 2 + Supervisor::MAX_RESTARTS
+        || !supervisor.healthy())
+    {
+        printf(
+            "supervisor: attempt %d, %u restarts after a beat\n",
+            fetch.attempt(), supervisor.restarts(0));
+        ++errors;
+    }
+
+    /* Out of attempts: unhealthy. */
+    fake_now_us += 10000;
+    supervisor.check();
+    if (supervisor.healthy() || supervisor.failed() != &fetch)
+    {
+        printf("supervisor: healthy after %d attempts\n", fetch.attempt());
+        ++errors;
+    }
+
+    /* A task that cannot restart fails at once. */
+    Supervisor other(fake_clock_us, 0);
+    other.watch(render, 20000);
+    fake_now_us += 20000;
+    other.check();
+    if (render.attempt() != 1 || other.healthy() || other.restarts(0))
+    {
+        printf("supervisor: render was not given up on\n");
+        ++errors;
+    }
+
+    printf("supervisor: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
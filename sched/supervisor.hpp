@@ -0,0 +1,94 @@
+/*
+ * sched/supervisor.hpp - part of PIM670 Zabbix Display
+ *
+ * A software watchdog per task. A watched task beat()s when it makes
+ * progress; when it stops beating, the supervisor restarts just that task
+ * (e.g. drops the HTTP connection, or reconnects USB) instead of letting
+ * the hardware watchdog reboot everything.
+ *
+ * A task that does not come back after MAX_RESTARTS attempts, or cannot
+ * be restarted at all, makes the supervisor unhealthy. That is when the
+ * hardware watchdog should take over: stop feeding it.
+ */
+#ifndef INCLUDED_SCHED_SUPERVISOR_HPP
+#define INCLUDED_SCHED_SUPERVISOR_HPP
+
+#include <cstdint>
+
+#include "sched/scheduler.hpp"
+
+namespace sched {
+
+class Supervisor : public Task
+{
+public:
+    static constexpr int MAX_WATCHED = 4;
+    static constexpr int MAX_RESTARTS = 3;
+    /* How often the task looks at the beats. */
+    static constexpr uint32_t CHECK_US = 100000;
+
+    /* As a task, it is called "supervisor". */
+    Supervisor(Clock clock_us, int priority)
+        : Task("supervisor", priority), m_clock_us(clock_us)
+    {
+    }
+
+    /* Restart task when it did not beat for timeout_us. Returns false
+     * if MAX_WATCHED tasks are watched already. */
+    bool watch(Task& task, uint32_t timeout_us);
+
+    /* Restart the tasks that stopped beating, now. */
+    void check();
+    uint32_t run(uint32_t) override
+    {
+        check();
+        return CHECK_US;
+    }
+
+    /* False from the first task that could not be restarted. */
+    bool healthy() const
+    {
+        return m_failed == nullptr;
+    }
+    /* That task, or null. */
+    const Task* failed() const
+    {
+        return m_failed;
+    }
+
+    /* The watched tasks and how often each was restarted. */
+    int watched() const
+    {
+        return m_count;
+    }
+    const Task& task(int index) const
+    {
+        return *m_watched[index].task;
+    }
+    uint32_t restarts(int index) const
+    {
+        return m_watched[index].restarts.get();
+    }
+
+private:
+    struct Watched
+    {
+        Task* task;
+        uint32_t timeout_us;
+        uint32_t restarted_us;
+        /* Restarts since the last beat. */
+        int attempts;
+        Counter restarts;
+    };
+
+    Clock m_clock_us;
+    Watched m_watched[MAX_WATCHED];
+    int m_count = 0;
+    const Task* m_failed = nullptr;
+};
+
+} // namespace sched
+
+#endif // INCLUDED_SCHED_SUPERVISOR_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -20,6 +20,7 @@
 
 #include "hardware/flash.h"
 #include "hardware/sync.h"
+#include "pico/multicore.h"
 
 
 /* Local headers. */
@@ -32,9 +33,55 @@
 static const uint32_t m_storage_size = FLASH_SECTOR_SIZE * 128;
 static const uint32_t m_storage_offset = PICO_FLASH_SIZE_BYTES - m_storage_size;
 
+/* The end of our code in flash, from the linker script. */
+extern char __flash_binary_end;
+
 
 /* Functions.*/
 
+/* Internal functions - used only in this file. */
+
+/*
+ * flash_begin - keeps the other core (if running) and interrupts off the
+ *               flash while we erase or program it; flash_end lets them
+ *               back on.
+ */
+
+static uint32_t storage_flash_begin( bool *p_lockout )
+{
+  /* If the other core is running, it must keep off the flash too. */
+  *p_lockout = multicore_lockout_victim_is_initialized( 1 - get_core_num() );
+  if ( *p_lockout )
+  {
+    multicore_lockout_start_blocking();
+  }
+
+  /* Don't want to be interrupted. */
+  return save_and_disable_interrupts();
+}
+
+static void storage_flash_end( uint32_t p_status, bool p_lockout )
+{
+  restore_interrupts( p_status );
+  if ( p_lockout )
+  {
+    multicore_lockout_end_blocking();
+  }
+}
+
+
+/*
+ * snapshot_offset - where a snapshot slot lives, as a flash offset.
+ */
+
+static uint32_t storage_snapshot_offset( uint32_t p_slot )
+{
+  return m_storage_offset - ( STORAGE_SNAPSHOT_SLOTS - p_slot ) * FLASH_SECTOR_SIZE;
+}
+
+
+/* Public functions. */
+
 /*
  * get_size - provides size information about storage. 
  */
@@ -77,9 +124,10 @@ int32_t storage_write( uint32_t p_sector, uint32_t p_offset,
                        const uint8_t *p_buffer, uint32_t p_size_bytes )
 {
   uint32_t l_status;
+  bool     l_lockout;
 
-  /* Don't want to be interrupted. */
-  l_status = save_and_disable_interrupts();
+  /* Keep everything else off the flash. */
+  l_status = storage_flash_begin( &l_lockout );
 
   /* Erasing with an offset of 0? Seems odd, but... */
   if ( p_offset == 0 )
@@ -93,12 +141,69 @@ int32_t storage_write( uint32_t p_sector, uint32_t p_offset,
     p_buffer, p_size_bytes
   );
 
-  /* Lastly, restore our interrupts. */
-  restore_interrupts( l_status );
+  /* Lastly, restore our interrupts and let the other core go. */
+  storage_flash_end( l_status, l_lockout );
 
   /* Before returning the amount of data written. */
   return p_size_bytes;
 }
 
 
+/*
+ * snapshot_slots - the number of snapshot slots: flash sectors just below
+ *                  the filesystem, for state that has to survive a reboot.
+ *                  They are outside FatFS, so the USB host never sees them.
+ *                  None if our own code would run into them.
+ */
+
+uint32_t storage_snapshot_slots( void )
+{
+  if ( (uint32_t)&__flash_binary_end - XIP_BASE > storage_snapshot_offset( 0 ) )
+  {
+    return 0;
+  }
+  return STORAGE_SNAPSHOT_SLOTS;
+}
+
+
+/*
+ * snapshot_read - a pointer to the contents of a slot, FLASH_SECTOR_SIZE
+ *                 bytes, uncached; erased flash reads as all ones.
+ */
+
+const uint8_t *storage_snapshot_read( uint32_t p_slot )
+{
+  return (const uint8_t *)XIP_NOCACHE_NOALLOC_BASE + storage_snapshot_offset( p_slot );
+}
+
+
+/*
+ * snapshot_write - replaces the contents of a slot. The size is rounded up
+ *                  to whole flash pages, and the buffer must hold that much.
+ */
+
+bool storage_snapshot_write( uint32_t p_slot, const uint8_t *p_buffer,
+                             uint32_t p_size_bytes )
+{
+  uint32_t l_status;
+  bool     l_lockout;
+
+  /* Sanity check the request. */
+  if ( p_slot >= storage_snapshot_slots() || p_size_bytes > FLASH_SECTOR_SIZE )
+  {
+    return false;
+  }
+  p_size_bytes = ( p_size_bytes + FLASH_PAGE_SIZE - 1 ) & ~( FLASH_PAGE_SIZE - 1 );
+
+  /* Same dance as storage_write. */
+  l_status = storage_flash_begin( &l_lockout );
+  flash_range_erase( storage_snapshot_offset( p_slot ), FLASH_SECTOR_SIZE );
+  flash_range_program( storage_snapshot_offset( p_slot ), p_buffer, p_size_bytes );
+  storage_flash_end( l_status, l_lockout );
+
+  /* All done. */
+  return true;
+}
+
+
 /* End of file usbfs/storage.cpp */
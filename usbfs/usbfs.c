@@ -29,6 +29,7 @@
 /* Module variables. */
 
 static FATFS m_fatfs;
+static uint32_t m_idle_us;
 
 
 /* Functions.*/
@@ -85,24 +86,61 @@ void usbfs_update( void )
 }
 
 
+/*
+ * update_pending - true if TinyUSB has events queued for update.
+ */
+
+bool usbfs_update_pending( void )
+{
+  return tud_task_event_ready();
+}
+
+
+/*
+ * disconnect - drop off the USB bus; connect - come back, to be enumerated
+ *              afresh by the host. For when TinyUSB stops keeping up.
+ */
+
+void usbfs_disconnect( void )
+{
+  tud_disconnect();
+}
+
+void usbfs_connect( void )
+{
+  tud_connect();
+}
+
+
 /*
  * sleep_ms - a replacement for the standard sleep_ms function; this will
- *            run update in a busy loop until we reach the requested time,
- *            to ensure that TinyUSB doesn't run into trouble.
+ *            run update until we reach the requested time, to ensure that
+ *            TinyUSB doesn't run into trouble. In between, the core sleeps
+ *            until an interrupt (USB, WiFi/lwIP, a timer) or the deadline.
  */
 
 void usbfs_sleep_ms( uint32_t p_milliseconds )
 {
   absolute_time_t l_target_time;
+  uint32_t        l_idle_start;
 
   /* Work out when we want to 'sleep' until. */
   l_target_time = make_timeout_time_ms( p_milliseconds );
 
-  /* Now enter a busy(ish) loop until that time. */
+  /* Now loop until that time, sleeping whenever TinyUSB has no work. */
   while( !time_reached( l_target_time ) )
   {
     /* Run any updates. */
     tud_task();
+
+    /* An interrupt that queues work after this check still wakes us, as
+     * taking it sets the event register. */
+    if ( !tud_task_event_ready() )
+    {
+      l_idle_start = time_us_32();
+      best_effort_wfe_or_timeout( l_target_time );
+      m_idle_us += time_us_32() - l_idle_start;
+    }
   }
 
   /* All done. */
@@ -110,6 +148,17 @@ void usbfs_sleep_ms( uint32_t p_milliseconds )
 }
 
 
+/*
+ * idle_us - the time spent asleep in sleep_ms, in microseconds; wraps
+ *           around every 71 minutes, so only use differences.
+ */
+
+uint32_t usbfs_idle_us( void )
+{
+  return m_idle_us;
+}
+
+
 /*
  * open - opens a file in the FatFS filesystem. Takes the same filename and mode
  *        strings as fopen()
@@ -22,6 +22,8 @@
 
 #define UFS_LABEL           "PicoW"
 
+#define STORAGE_SNAPSHOT_SLOTS  4
+
 
 /* Structures */
 
@@ -50,7 +52,11 @@ extern "C" {
 
 void            usbfs_init( void );
 void            usbfs_update( void );
+bool            usbfs_update_pending( void );
+void            usbfs_disconnect( void );
+void            usbfs_connect( void );
 void            usbfs_sleep_ms( uint32_t );
+uint32_t        usbfs_idle_us( void );
 
 usbfs_file_t   *usbfs_open( const char *, const char * );
 bool            usbfs_close( usbfs_file_t * );
@@ -60,6 +66,11 @@ char           *usbfs_gets( char *, size_t, usbfs_file_t * );
 size_t          usbfs_puts( const char *, usbfs_file_t * );
 uint32_t        usbfs_timestamp( const char * );
 
+/* Flash outside the filesystem, for state that survives a reboot. */
+uint32_t        storage_snapshot_slots( void );
+const uint8_t  *storage_snapshot_read( uint32_t );
+bool            storage_snapshot_write( uint32_t, const uint8_t *, uint32_t );
+
 #ifdef __cplusplus
 }
 #endif
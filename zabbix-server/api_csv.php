@@ -26,6 +26,9 @@ if (@$_SERVER['REQUEST_METHOD'] === 'OPTIONS') {
 	return;
 }
 
+// Warnings and notices go to the log, not into the CSV the device parses.
+ini_set('display_errors', '0');
+
 // When called from CLI, we'll pretend it's from localhost.
 if (!@$_SERVER['REMOTE_ADDR']) {
 	$_SERVER['REQUEST_METHOD'] = 'GET';
@@ -49,11 +52,6 @@ if ($_SERVER['REQUEST_METHOD'] !== 'GET') {
 //
 @include_once 'api_csv_prelude.php';
 
-if (!ob_start()) {
-	echo "ERR: no ob_start();\n";
-	exit;
-}
-
 require_once dirname(__LINKFILE__).'/include/func.inc.php';
 require_once dirname(__LINKFILE__).'/include/classes/core/CHttpRequest.php';
 
@@ -178,8 +176,6 @@ try {
 			return strcmp(implode("\0", $a), implode("\0", $b));
 		});
 
-		$csv_output = array();
-
 		// Add example triggers.
 		for ($i = 0; $i < 0; ++$i) {
 			array_push($triggers, array(
@@ -192,18 +188,25 @@ try {
 			));
 		}
 
-		if (empty($triggers)) {
-			// Always non-zero output (right now PIM fails on content-length 0)
-			//array_push($csv_output, "void");
-		} else {
-			array_push($csv_output, implode(";", array_keys($triggers[0])));
+		// There is no Content-Length: how the body is framed is up to
+		// the SAPI and web server (over HTTP/1.1 usually chunked, which
+		// the PIM670 reads as well as a Content-Length). The
+		// rows only exist after the API calls and the sort above; from
+		// there we flush them out every so often, instead of holding
+		// all of them. No triggers, no output, not even the header.
+		while (ob_get_level() > 0) {
+			ob_end_flush();
 		}
-		foreach ($triggers as $trigger) {
-			array_push($csv_output, implode(";", $trigger));
+		if (!empty($triggers)) {
+			echo implode(";", array_keys($triggers[0])) . "\n";
+			flush();
 		}
-		$csv_output = implode("\n", $csv_output);
-		if (!empty($csv_output)) {
-			$csv_output .= "\n";
+		$rows = 0;
+		foreach ($triggers as $trigger) {
+			echo implode(";", $trigger) . "\n";
+			if (++$rows % 50 == 0) {
+				flush();
+			}
 		}
 	}
 }
@@ -220,23 +223,9 @@ catch (Exception $e) {
 		],
 		'id' => (isset($jsonData['id']) ? $jsonData['id'] : null)
 	];
-	$csv_output = '';
-	$csv_output .= implode(';', array('jsonrpc', 'error.code', 'error.message', 'error.data', 'id')) . "\n";
-	$csv_output .= '2.0;' . implode(';', $response['error']) . ";$response[id]@$_SERVER[REMOTE_ADDR]\n";
+	echo implode(';', array('jsonrpc', 'error.code', 'error.message', 'error.data', 'id')) . "\n";
+	echo '2.0;' . implode(';', $response['error']) . ";$response[id]@$_SERVER[REMOTE_ADDR]\n";
 }
 
-// One output. Except we write it to the buffer.
-echo $csv_output;
-
-// PHP is smart enough to disable "Transfer-Encoding: chunked" once the
-// content-length is set.
-// NOTE: We use ob_start/ob_get_clean to make sure we capture EVERYTHING. If
-// there are stray errors or prints, we need them too.
-$real_output = ob_get_clean();
-// We need to set this because the HTTP client in the PIM670 device is
-// rather dumb.
-header('Content-Length: ' . strlen($real_output));
-echo $real_output;
-
 session_write_close();  // FIXME: not sure if we want this.. we don't need any session data
 // vim: set ts=8 sw=8 sts=8 noet ai:
@@ -0,0 +1,209 @@
+/*
+ * zabbix/csvreader.cpp - part of PIM670 Zabbix Display
+ */
+
+#include "opt/placement.h"
+#include "zabbix/csvreader.hpp"
+
+#ifdef RUNTESTS
+# include <cstdio>
+# include <cstring>
+# include <vector>
+#endif
+
+namespace zabbix {
+
+HOT_PATH("csv") size_t CsvReader::feed(const char* data, size_t len)
+{
+    m_ready = false;
+    for (size_t i = 0; i < len; ++i)
+    {
+        char c = data[i];
+        if (c == '\n')
+        {
+            end_row();
+            if (m_ready)
+            {
+                return i + 1;
+            }
+            continue;
+        }
+        if (c == '\r' || m_header)
+        {
+            continue;
+        }
+        if (m_empty)
+        {
+            m_row = Row{};
+            m_empty = false;
+        }
+        if (c == ';')
+        {
+            if (m_field < 4 && !m_digits)
+            {
+                m_bad = true;
+            }
+            switch (m_field)
+            {
+            case 0:
+                m_row.clock = m_value;
+                break;
+            case 1:
+                m_row.severity = m_value;
+                break;
+            case 2:
+                m_row.suppressed = m_value;
+                break;
+            case 3:
+                m_row.hostid = m_value;
+                break;
+            }
+            ++m_field;
+            m_value = 0;
+            m_digits = false;
+        }
+        else if (m_field >= 4)
+        {
+            /* Host or name. */
+        }
+        else if (c >= '0' && c <= '9' && m_value <= (UINT32_MAX - 9) / 10)
+        {
+            m_value = m_value * 10 + (c - '0');
+            m_digits = true;
+        }
+        else
+        {
+            m_bad = true;
+        }
+    }
+    return len;
+}
+
+bool CsvReader::finish()
+{
+    m_ready = false;
+    if (!m_empty)
+    {
+        end_row();
+    }
+    return m_ready;
+}
+
+void CsvReader::reset()
+{
+    *this = CsvReader();
+}
+
+void CsvReader::end_row()
+{
+    if (m_header)
+    {
+        m_header = false;
+    }
+    else if (!m_empty)
+    {
+        m_row.valid = !m_bad && m_field == FIELDS - 1;
+        m_ready = true;
+        ++m_rows;
+    }
+    m_empty = true;
+    m_bad = false;
+    m_field = 0;
+    m_digits = false;
+    m_value = 0;
+}
+
+} // namespace zabbix
+
+#ifdef RUNTESTS
+using namespace zabbix;
+
+static const char* csv =
+    "clock;severity;suppressed;hostid;host;name\n"
+    "1733896822;5;0;12847;node1.example.com;CPU 25+% busy\n"
+    "\n"
+    "1733896900;4;1;12848;node2.example.com;Disk; almost full\r\n"
+    "1733897000;x;0;12849;node3.example.com;Bad severity\n"
+    "1733897100;3;0\n"
+    "1733897200;2;0;12850;node4.example.com;No newline";
+
+/* Feeds csv in pieces of step bytes; returns the rows. */
+static std::vector<CsvReader::Row> read_all(CsvReader& reader, size_t step)
+{
+    std::vector<CsvReader::Row> rows;
+    size_t len = strlen(csv);
+    for (size_t pos = 0; pos < len; pos += step)
+    {
+        const char* data = csv + pos;
+        size_t left = (len - pos < step) ? len - pos : step;
+        while (left)
+        {
+            size_t taken = reader.feed(data, left);
+            data += taken;
+            left -= taken;
+            if (reader.row_ready())
+            {
+                rows.push_back(reader.row());
+            }
+        }
+    }
+    if (reader.finish())
+    {
+        rows.push_back(reader.row());
+    }
+    return rows;
+}
+
+int main()
+{
+    int errors = 0;
+    CsvReader reader;
+
+    /* The same rows, however the data is cut up. */
+    for (size_t step : {1, 2, 7, 64, 1000})
+    {
+        reader.reset();
+        std::vector<CsvReader::Row> rows = read_all(reader, step);
+        if (rows.size() != 5 || reader.rows() != 5)
+        {
+            printf("csvreader: step %zu: %zu rows\n", step, rows.size());
+            ++errors;
+            continue;
+        }
+        const CsvReader::Row& first = rows[0];
+        if (!first.valid || first.clock != 1733896822 || first.severity != 5
+            || first.suppressed != 0 || first.hostid != 12847)
+        {
+            printf("csvreader: step %zu: bad first row\n", step);
+            ++errors;
+        }
+        const CsvReader::Row& last = rows[4];
+        if (!last.valid || last.clock != 1733897200 || last.hostid != 12850)
+        {
+            printf("csvreader: step %zu: bad last row\n", step);
+            ++errors;
+        }
+        /* A separator in the name, a bad number, missing fields. */
+        if (rows[1].valid || rows[2].valid || rows[3].valid)
+        {
+            printf("csvreader: step %zu: bad rows taken as valid\n", step);
+            ++errors;
+        }
+    }
+
+    /* A number too large for 32 bits is not one. */
+    reader.reset();
+    const char* big = "h\n99999999999;5;0;1;h;n\n";
+    size_t taken = reader.feed(big, strlen(big));
+    if (!reader.row_ready() || reader.row().valid || taken != strlen(big))
+    {
+        printf("csvreader: overflow not caught\n");
+        ++errors;
+    }
+
+    printf("csvreader: %d errors\n", errors);
+    return errors ? 1 : 0;
+}
+#endif // RUNTESTS
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */
@@ -0,0 +1,81 @@
+/*
+ * zabbix/csvreader.hpp - part of PIM670 Zabbix Display
+ *
+ * Reads the CSV from api_csv.php as it comes in, in pieces of any size,
+ * without keeping more than the row at hand:
+ *
+ *   clock;severity;suppressed;hostid;host;name
+ *   1733896822;5;0;12847;node1.example.com;CPU 25+% busy
+ *
+ * The first line is the header and empty lines are skipped. Host and name
+ * are not kept, so no field is buffered: numbers add up digit by digit.
+ * A row with a missing field or a number that is not one is still a row,
+ * but not a valid one.
+ */
+#ifndef INCLUDED_ZABBIX_CSVREADER_HPP
+#define INCLUDED_ZABBIX_CSVREADER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zabbix {
+
+class CsvReader
+{
+public:
+    static constexpr int FIELDS = 6;
+
+    struct Row
+    {
+        uint32_t clock;
+        uint32_t hostid;
+        uint8_t severity;
+        uint8_t suppressed;
+        bool valid;
+    };
+
+    /* Takes data up to and including the end of the next row, or all of
+     * it; returns how much. If that ended a row, row_ready() is true
+     * until the next call. */
+    size_t feed(const char* data, size_t len);
+    /* The data ended; a last row without a newline counts too. Returns
+     * true if that made a row ready. */
+    bool finish();
+    /* Start over, for the next response. */
+    void reset();
+
+    bool row_ready() const
+    {
+        return m_ready;
+    }
+    const Row& row() const
+    {
+        return m_row;
+    }
+    /* Rows so far, without the header and empty lines. */
+    uint32_t rows() const
+    {
+        return m_rows;
+    }
+
+private:
+    /* At the end of a line: make it a row, unless it is the header or
+     * empty. */
+    void end_row();
+
+    Row m_row = {};
+    bool m_ready = false;
+    bool m_header = true;
+    bool m_empty = true;
+    bool m_bad = false;
+    int m_field = 0;
+    bool m_digits = false;
+    uint32_t m_value = 0;
+    uint32_t m_rows = 0;
+};
+
+} // namespace zabbix
+
+#endif // INCLUDED_ZABBIX_CSVREADER_HPP
+
+/* vim: set ts=8 sw=4 sts=4 et ai: */